@@ -52,7 +52,7 @@ public:
     CUDA_HOST_DEVICE
     virtual
     std::array<T,1>
-    operator()(std::default_random_engine* rng){
+    operator()(mqi::philox4x32* rng){
         return pdf_Md<T,1>::mean_;
     };
 
@@ -51,8 +51,9 @@ public:
     CUDA_HOST_DEVICE
     virtual
     std::array<T,1>
-    operator()(std::default_random_engine* rng){
-        return {func_(*rng)};
+    operator()(mqi::philox4x32* rng){
+        std::normal_distribution<T> func(func_.param());
+        return {func(*rng)};
     };
 
 };
@@ -19,6 +19,7 @@
 #include <moqui/base/mqi_math.hpp>
 #include <moqui/base/mqi_vec.hpp>
 #include <moqui/base/mqi_matrix.hpp>
+#include <moqui/base/mqi_philox.hpp>
 
 
 namespace mqi{
@@ -74,10 +75,14 @@ public:
 
 
     /// '()' operator overloading to act like a function. 
+    /// Distributions are shared by the threads sampling vertices, so the call
+    /// must not change them: std distributions that keep state between calls
+    /// (normal_distribution caches every other number) are copied locally.
+    /// \param rng positioned at the vertex stream of the history
     CUDA_HOST_DEVICE
     virtual 
     std::array<T,M>
-    operator()(std::default_random_engine* rng) = 0;
+    operator()(mqi::philox4x32* rng) = 0;
 
 };
 
@@ -77,16 +77,17 @@ public:
     CUDA_HOST_DEVICE
     virtual 
     std::array<T,6>
-    operator()(std::default_random_engine* rng)
+    operator()(mqi::philox4x32* rng)
     {
 	    auto x = unifx_(*rng) ;
 	    auto y = unify_(*rng) ;
 	
 	    mqi::vec3<T> dir(std::atan(x/SAD_[0]), std::atan(y/SAD_[1]), -1.0);
 
+        std::normal_distribution<T> func(func_.param());
         std::array<T,6> phsp ; 
-        T Ux = func_(*rng); T Vx = func_(*rng);
-        T Uy = func_(*rng); T Vy = func_(*rng);
+        T Ux = func(*rng); T Vx = func(*rng);
+        T Uy = func(*rng); T Vy = func(*rng);
 
         phsp[0] = x + pdf_Md<T,6>::sigma_[0]* Ux ; 
         phsp[1] = y + pdf_Md<T,6>::sigma_[1]* Uy ; 
@@ -71,13 +71,15 @@ public:
     /// Sample 6 phase-space variables and returns
     CUDA_HOST_DEVICE
     virtual std::array<T, 6>
-    operator()(std::default_random_engine* rng) {
+    operator()(mqi::philox4x32* rng) {
+        std::normal_distribution<T> func(func_.param());
+
         std::array<T, 6> phsp = pdf_Md<T, 6>::mean_;
-        T                Ux   = func_(*rng);
-        T                Vx   = func_(*rng);
-        T                Uy   = func_(*rng);
-        T                Vy   = func_(*rng);
-        T                Uz   = func_(*rng);   //T Vz = func_(rng);
+        T                Ux   = func(*rng);
+        T                Vx   = func(*rng);
+        T                Uy   = func(*rng);
+        T                Vy   = func(*rng);
+        T                Uz   = func(*rng);   //T Vz = func_(rng);
         T                z    = this->source_position;
         T                A0_x = rho_[0] * rho_[0];
         T                A1_x = pdf_Md<T, 6>::sigma_[3];
@@ -240,10 +240,9 @@ public:
         uint32_t h1    = this->beamsource.total_histories();
         this->vertices = new mqi::vertex_t<R>[h1 - h0];
 
-        for (size_t i = 0; i < (h1 - h0); ++i) {
-            auto bl           = this->beamsource(h0 + i);
-            this->vertices[i] = bl(&this->beam_rng);
-        }
+        ///< on all hardware threads, the vertices do not depend on their number
+        mqi::thread_pool pool(mqi::cpu_thread_count(-1));
+        this->beamsource.sample_vertices(h0, h1, this->vertices, this->random_seed, 0, &pool);
     }
 
     CUDA_HOST
@@ -300,7 +299,8 @@ public:
 #else
         fp0             = mqi::dose_to_water;
 #endif
-        phantom->scorers[0] = new mqi::scorer<R>("water_dE_total", nxyz.x * nxyz.y * nxyz.z, fp0);
+        phantom->scorers[0] = new mqi::scorer<R>(
+          "water_dE_total", nxyz.x * nxyz.y * nxyz.z, fp0, mqi::DOSE_TO_WATER_HIT);
         mqi::key_value* deposit0 = new mqi::key_value[phantom->scorers[0]->max_capacity_];
         std::memset(deposit0, 0xff, sizeof(mqi::key_value) * phantom->scorers[0]->max_capacity_);
         init_table(deposit0, phantom->scorers[0]->max_capacity_);
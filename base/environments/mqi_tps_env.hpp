@@ -29,8 +29,10 @@
 #include <moqui/base/materials/mqi_patient_materials.hpp>
 #include <moqui/base/mqi_aperture.hpp>
 #include <moqui/base/mqi_aperture3d.hpp>
+#include <moqui/base/mqi_batch_pipeline.hpp>
 #include <moqui/base/mqi_distributions.hpp>
 #include <moqui/base/mqi_file_handler.hpp>
+#include <moqui/base/mqi_history_scheduler.hpp>
 #include <moqui/base/mqi_io.hpp>
 #include <moqui/base/mqi_math.hpp>
 #include <moqui/base/mqi_rangeshifter.hpp>
@@ -168,6 +170,26 @@ public:
     uint32_t                   scorer_capacity;
     bool                       reshape_output = false;
     bool                       sparse_output  = false;
+    mqi::thread_pool*          cpu_pool       = nullptr;   ///< CPU transport workers
+    bool                       cpu_work_stealing = false;     ///< CPUScheduler WorkStealing
+    mqi::history_scheduler*    cpu_scheduler     = nullptr;   ///< used with cpu_work_stealing
+    bool                       cpu_private_scoring = false;   ///< CPUScoring Private
+    ///< ScoringSlices: history slices of CPUScoring Private, merged in slice order.
+    ///< The sums are bitwise identical for any number of threads at a fixed slice
+    ///< count; 0 takes one slice per thread, so the sums depend on the threads.
+    uint32_t                   scoring_slices      = 64;
+    std::vector<mqi::scoring_buffer> scoring_buffers;        ///< slice-major private buffers
+    std::string                scorer_table = "Auto";   ///< ScorerTable Auto|Dense|Packed|KeyValue
+    bool                       woodcock_tracking  = false;   ///< TransportMode Woodcock (CPU)
+    bool                       validate_transport = false;   ///< ValidateTransport
+    int                        super_voxel_size      = 0;       ///< SuperVoxelSize, 0: off (CPU)
+    float                      super_voxel_tolerance = 0.01f;   ///< SuperVoxelTolerance
+    int                        majorant_block_size   = 8;   ///< MajorantBlockSize, 0: one majorant
+    bool                       spr_lookup_table = true;   ///< StoppingPowerRatio Table|Exact (CPU)
+    std::vector<mqi::scoring_buffer> validation_buffers;   ///< voxel-by-voxel reference per thread
+    size_t                     batch_first_history = 0;   ///< history index of vertex 0 of the batch
+    bool                       vertex_pipeline     = false;   ///< VertexPipeline, generate during transport
+    uint32_t                   track_stack_spill   = 16;   ///< TrackStackSpill, tracks per CUDA thread
     //    std::default_random_engine beam_rng;
 
 public:
@@ -200,6 +222,25 @@ public:
         use_absolute_path = parser.get_bool("UseAbsolutePath", false);
 
         this->num_total_threads = parser.get_int("TotalThreads", -1);
+        cpu_work_stealing =
+          strcasecmp(parser.get_string("CPUScheduler", "Static").c_str(), "WorkStealing") == 0;
+        cpu_private_scoring =
+          strcasecmp(parser.get_string("CPUScoring", "Shared").c_str(), "Private") == 0;
+        scoring_slices = parser.get_int("ScoringSlices", 64);
+        scorer_table = parser.get_string("ScorerTable", "Auto");
+        woodcock_tracking =
+          strcasecmp(parser.get_string("TransportMode", "Voxel").c_str(), "Woodcock") == 0;
+        validate_transport = parser.get_bool("ValidateTransport", false);
+        vertex_pipeline    = parser.get_bool("VertexPipeline", false);
+        track_stack_spill  = parser.get_int("TrackStackSpill", 16);
+        super_voxel_size      = parser.get_int("SuperVoxelSize", 0);
+        super_voxel_tolerance = parser.get_float("SuperVoxelTolerance", 0.01f);
+        majorant_block_size   = parser.get_int("MajorantBlockSize", 8);
+        spr_lookup_table =
+          strcasecmp(parser.get_string("StoppingPowerRatio", "Table").c_str(), "Exact") != 0;
+#if !defined(__CUDACC__)
+        if (spr_lookup_table) mqi::spr_table.build();
+#endif
         beam_prefix             = parser.get_string("BeamPrefix", "beam");
         max_histories_per_batch = parser.get_int("MaxHistoriesPerBatch", 0);
         //        std::string aperture_string = parser.get_string("ApertureType", "VOLUME");
@@ -261,6 +302,12 @@ public:
         this->scorer_string =
           parser.get_string("Scorer", "EnergyDeposition");   // assumes only one scorer
         scorer_type = parser.string_to_scorer_type(this->scorer_string);
+#if defined(__CUDACC__)
+        ///< the LETd quantities of the dose scorer are not uploaded to the device
+        if (scorer_type == mqi::LETd) {
+            throw std::runtime_error("Scorer LETd requires the CPU build.");
+        }
+#endif
 
         // -------------------------------------------------------------------------------------------
         //// Set simulation type to per spot for dose dij matrix scoring
@@ -399,7 +446,8 @@ public:
 
     CUDA_HOST
     ~tps_env() {
-        ;
+        delete cpu_scheduler;
+        delete cpu_pool;
     }
 
     CUDA_HOST
@@ -412,6 +460,20 @@ public:
         printf("GPU_ID %d\n", this->gpu_id);
         printf("Random seed %d\n", master_seed);
         printf("The number of total threads %d\n", this->num_total_threads);
+        printf("CPU scheduler %s\n", cpu_work_stealing ? "WorkStealing" : "Static");
+        printf("CPU scoring %s (slices %u)\n", cpu_private_scoring ? "Private" : "Shared", scoring_slices);
+        if (cpu_private_scoring && scoring_slices == 0) {
+            printf("  one slice per thread: set ScoringSlices for sums independent of the threads\n");
+        }
+        printf("Scorer table %s\n", scorer_table.c_str());
+        printf("Transport mode %s%s\n",
+               woodcock_tracking ? "Woodcock" : "Voxel",
+               (woodcock_tracking && validate_transport) ? " (validated against Voxel)" : "");
+        if (woodcock_tracking) printf("Majorant block size %d\n", majorant_block_size);
+        printf("Super-voxel size %d (tolerance %f)\n", super_voxel_size, super_voxel_tolerance);
+        printf("Stopping power ratio %s\n", spr_lookup_table ? "Table" : "Exact");
+        printf("Vertex pipeline %s\n", vertex_pipeline ? "on" : "off");
+        printf("Track stack spill %u tracks per CUDA thread\n", track_stack_spill);
         printf("Maximum histories per batch %lu\n", max_histories_per_batch);
         printf("================================\n");
         printf("Setup parameters\n");
@@ -1225,33 +1287,76 @@ public:
             roi_tmp =
               new roi_t(mqi::DIRECT, this->dcm_.dim_.x * this->dcm_.dim_.y * this->dcm_.dim_.z);
         }
-        if (this->scorer_type == mqi::LETd || this->scorer_type == mqi::LETt) {
-            phantom->n_scorers = 2;   // need two scorers for LET scoring
-        } else {
-            phantom->n_scorers = 1;
-        }
+        ///< LETd is scored by the dose scorer itself: its table slots also hold the
+        ///< LETd numerator and denominator (DOSE_LETD_HIT, CPU only; CUDA builds
+        ///< reject Scorer LETd when the parameters are read)
         phantom->n_scorers = 1;
 
         phantom->scorers = new scorer<R>*[phantom->n_scorers];
         fp_compute_hit<R> fp0;
+        mqi::hit_t        hit0 = mqi::DOSE_TO_WATER_HIT;
 
 #if defined(__CUDACC__)
         cudaMemcpyFromSymbol(&fp0, mqi::Dw_pointer, sizeof(fp_compute_hit<R>));
 #else
         fp0             = mqi::dose_to_water;
+        if (this->scorer_type == mqi::LETd) hit0 = mqi::DOSE_LETD_HIT;
 #endif
         phantom->scorers[0] =
-          new mqi::scorer<R>(this->scorer_string.c_str(),
+          new mqi::scorer<R>((hit0 == mqi::DOSE_LETD_HIT) ? "Dose" : this->scorer_string.c_str(),
                              this->dcm_.dim_.x * this->dcm_.dim_.y * this->dcm_.dim_.z,
-                             fp0);
-
-        mqi::key_value* deposit0 = new mqi::key_value[phantom->scorers[0]->max_capacity_];
+                             fp0,
+                             hit0);
+
+        ///< Auto: a dense voxel array for per-beam runs, where every deposit is keyed by
+        ///< voxel only, and the key_value table otherwise.
+        bool use_dense_table  = false;
+        bool use_packed_table = false;
+#if !defined(__CUDACC__)
+        ///< dense and packed tables are not uploaded to GPU
+        if (strcasecmp(scorer_table.c_str(), "Auto") == 0) {
+            use_dense_table = (this->sim_type == mqi::PER_BEAM);
+        } else if (strcasecmp(scorer_table.c_str(), "Dense") == 0) {
+            use_dense_table = (this->sim_type == mqi::PER_BEAM);
+            if (!use_dense_table) printf("ScorerTable Dense requires perBeam, using KeyValue\n");
+        } else {
+            use_packed_table = strcasecmp(scorer_table.c_str(), "Packed") == 0;
+        }
+#endif
+        if (use_dense_table) {
+            phantom->scorers[0]->dense_ = new double[phantom->scorers[0]->max_capacity_]();
+        } else if (use_packed_table) {
+            phantom->scorers[0]->packed_ = new mqi::packed_table(phantom->scorers[0]->max_capacity_);
+            phantom->scorers[0]->max_capacity_ = phantom->scorers[0]->packed_->capacity_;
+        } else {
+            mqi::key_value* deposit0 = new mqi::key_value[phantom->scorers[0]->max_capacity_];
 
-        std::memset(deposit0, 0xff, sizeof(mqi::key_value) * phantom->scorers[0]->max_capacity_);
+            std::memset(
+              deposit0, 0xff, sizeof(mqi::key_value) * phantom->scorers[0]->max_capacity_);
 
-        init_table(deposit0, phantom->scorers[0]->max_capacity_);
+            init_table(deposit0, phantom->scorers[0]->max_capacity_);
 
-        phantom->scorers[0]->data_           = deposit0;
+            phantom->scorers[0]->data_ = deposit0;
+        }
+        phantom->scorers[0]->allocate_quantities();
+#if !defined(__CUDACC__)
+        ///< Woodcock tracking samples steps against the densest voxel of the block
+        ///< they start in; the node majorant is used without blocks
+        if (woodcock_tracking) {
+            phantom->majorant_density = phantom->geo->max_data();
+            phantom->geo->build_majorants(majorant_block_size);
+            printf("Woodcock majorants: %lu blocks of %d^3 voxels\n",
+                   (unsigned long) phantom->geo->n_majorant_blocks(),
+                   majorant_block_size);
+        }
+        ///< Homogeneous blocks (water phantom, air around the patient) are crossed in one step
+        if (super_voxel_size > 1) {
+            phantom->geo->build_super_voxels(super_voxel_size, super_voxel_tolerance);
+            printf("Super-voxels: %lu of %d^3 voxels are homogeneous\n",
+                   (unsigned long) phantom->geo->n_homogeneous_blocks(),
+                   super_voxel_size);
+        }
+#endif
         phantom->scorers[0]->score_variance_ = this->score_variance;
         phantom->scorers[0]->roi_            = roi_tmp;
 
@@ -1388,13 +1493,21 @@ public:
             //printf("Geometry occupies %f GB\n", (total - free) / (1024.0 * 1024.0 * 1024.0));
             std::cout << "Starting simulation per field.. : Geometry allocated memory --> " << (total - free) / (1024.0 * 1024.0 * 1024.0) << " GB" << std::endl;
 #endif
-            run_by_beam();
+            if (vertex_pipeline) {
+                run_pipelined(false);
+            } else {
+                run_by_beam();
+            }
         } else if (this->sim_type == mqi::PER_SPOT) {
 #if defined(__CUDACC__)
             cudaMemGetInfo(&free, &total);
             printf("Geometry occupies %f GB\n", (total - free) / (1024.0 * 1024.0 * 1024.0));
 #endif
-            run_by_spot();
+            if (vertex_pipeline) {
+                run_pipelined(true);
+            } else {
+                run_by_spot();
+            }
         }
     }   // run
 
@@ -1468,10 +1581,30 @@ public:
                                tracked_particles,
                                sizeof(tracked_particles[0]),
                                cudaMemcpyHostToDevice));
+        ///< secondaries beyond the stack in the thread's frame go to a per-thread buffer
+        mqi::track_stack_spill_t<R> spill;
+        uint32_t                    stack_counters[2] = { 0, 0 };
+        spill.capacity                                = track_stack_spill;
+        if (spill.capacity > 0) {
+            gpu_err_chk(cudaMalloc(&spill.buffer,
+                                   size_t(n_blocks) * n_threads * spill.capacity *
+                                     sizeof(mqi::track_t<R>)));
+        }
+        gpu_err_chk(cudaMalloc(&spill.counters, sizeof(stack_counters)));
+        gpu_err_chk(cudaMemcpy(
+          spill.counters, stack_counters, sizeof(stack_counters), cudaMemcpyHostToDevice));
         printf("Starting transportation call.. \n");
         printf("Printing simulation specification.. : Histories per batch --> %d\n", histories_per_batch);
-        mc::transport_particles_patient<R><<<n_blocks, n_threads>>>(
-          worker_threads, mc::mc_world, mc::mc_vertices, histories_in_batch, d_tracked_particles);
+        mc::transport_particles_patient<R><<<n_blocks, n_threads>>>(worker_threads,
+                                                                    mc::mc_world,
+                                                                    mc::mc_vertices,
+                                                                    histories_in_batch,
+                                                                    d_tracked_particles,
+                                                                    nullptr,
+                                                                    true,
+                                                                    1,
+                                                                    0,
+                                                                    spill);
         cudaDeviceSynchronize();
         check_cuda_last_error("(transport particle table)");
 
@@ -1480,39 +1613,170 @@ public:
                                d_tracked_particles,
                                sizeof(tracked_particles[0]),
                                cudaMemcpyDeviceToHost));
+        gpu_err_chk(cudaMemcpy(
+          stack_counters, spill.counters, sizeof(stack_counters), cudaMemcpyDeviceToHost));
+        if (stack_counters[1] > 0) {
+            printf("Warning: track stacks full, %u secondaries dropped (%u spilled pushes, "
+                   "TrackStackSpill %u)\n",
+                   stack_counters[1],
+                   stack_counters[0],
+                   track_stack_spill);
+        } else if (this->debug_mode) {
+            printf("Secondary track stacks: %u spilled pushes\n", stack_counters[0]);
+        }
+        if (spill.buffer) gpu_err_chk(cudaFree(spill.buffer));
+        gpu_err_chk(cudaFree(spill.counters));
         gpu_err_chk(cudaFree(d_tracked_particles));
         gpu_err_chk(cudaFree(worker_threads));
         gpu_err_chk(cudaFree(mc::mc_vertices));
 #else
-        n_threads       = 1;
         mc::mc_vertices = this->vertices;
         mc::mc_world    = this->world;
-        /// TODO: number of threads for multithreading implementation
+        ///< the pool keeps TotalThreads workers; a small batch runs on fewer of them
+        mqi::thread_pool* pool = this->vertex_pool();
+        n_threads              = pool->size();
+        if (histories_in_batch < n_threads) n_threads = (histories_in_batch > 0) ? histories_in_batch : 1;
+        printf("Printing simulation specification.. : CPU thread size --> %d\n", n_threads);
+        mqi::track_stack_counters.reset();
         worker_threads = new mqi::thrd_t[n_threads];
-        initialize_threads(worker_threads, n_threads, this->master_seed);
+        initialize_threads(worker_threads, n_threads, this->master_seed, this->bnb);
+        for (uint32_t i = 0; i < n_threads; ++i) {
+            worker_threads[i].rnd_generator.history_offset = this->batch_first_history;
+        }
         printf("Thread initialization complete!\n");
-        mc::transport_particles_patient<R>(
-          worker_threads, mc::mc_world, mc::mc_vertices, histories_in_batch, tracked_particles);
+        if (cpu_private_scoring) {
+            ///< fixed history slices score into private buffers, merged in slice order
+            const uint32_t n_scorers = mc::total_scorers(mc::mc_world);
+            const uint32_t n_slices  = (scoring_slices > 0) ? scoring_slices : n_threads;
+            if (scoring_buffers.size() != size_t(n_slices) * n_scorers) {
+                scoring_buffers.assign(size_t(n_slices) * n_scorers, mqi::scoring_buffer());
+            }
+            std::atomic<uint32_t> next_slice(0);
+            pool->run(
+              [&](uint32_t thread_id, uint32_t) {
+                  for (uint32_t slice = next_slice++; slice < n_slices; slice = next_slice++) {
+                      const mqi::vec2<uint32_t> h_range =
+                        mqi::start_and_length(n_slices, histories_in_batch, slice);
+                      mc::transport_histories<R>(&worker_threads[thread_id].rnd_generator,
+                                                 mc::mc_world,
+                                                 mc::mc_vertices,
+                                                 h_range.x,
+                                                 h_range.x + h_range.y,
+                                                 tracked_particles,
+                                                 nullptr,
+                                                 true,
+                                                 &scoring_buffers[size_t(slice) * n_scorers]);
+                  }
+              },
+              n_threads);
+            mc::reduce_scoring_buffers<R>(*pool, mc::mc_world, scoring_buffers.data(), n_slices);
+        } else if (cpu_work_stealing) {
+            ///< histories are handed out in chunks; idle threads steal from busy ones
+            if (!cpu_scheduler || cpu_scheduler->size() != n_threads) {
+                delete cpu_scheduler;
+                cpu_scheduler = new mqi::history_scheduler(n_threads);
+            }
+            cpu_scheduler->run(
+              *pool, histories_in_batch, [&](uint32_t thread_id, uint32_t begin, uint32_t end) {
+                  mc::transport_histories<R>(&worker_threads[thread_id].rnd_generator,
+                                             mc::mc_world,
+                                             mc::mc_vertices,
+                                             begin,
+                                             end,
+                                             tracked_particles);
+              });
+            cpu_scheduler->print_stats(this->debug_mode);
+        } else {
+            pool->run(
+              [&](uint32_t thread_id, uint32_t total_threads) {
+                  mc::transport_particles_patient<R>(worker_threads,
+                                                     mc::mc_world,
+                                                     mc::mc_vertices,
+                                                     histories_in_batch,
+                                                     tracked_particles,
+                                                     nullptr,
+                                                     true,
+                                                     total_threads,
+                                                     thread_id);
+              },
+              n_threads);
+        }
+        if (woodcock_tracking && validate_transport) {
+            ///< transport the batch again voxel-by-voxel into separate buffers
+            const uint32_t n_scorers = mc::total_scorers(mc::mc_world);
+            if (validation_buffers.size() != size_t(n_threads) * n_scorers) {
+                validation_buffers.resize(size_t(n_threads) * n_scorers);
+            }
+            ///< without Woodcock steps and super-voxel steps
+            std::vector<R> majorants(mc::mc_world->n_children);
+            for (uint32_t c_ind = 0; c_ind < mc::mc_world->n_children; c_ind++) {
+                majorants[c_ind] = mc::mc_world->children[c_ind]->majorant_density;
+                mc::mc_world->children[c_ind]->majorant_density = 0;
+                mc::mc_world->children[c_ind]->geo->enable_super_voxels(false);
+            }
+            uint32_t validation_tracked = 0;
+            pool->run(
+              [&](uint32_t thread_id, uint32_t total_threads) {
+                  const mqi::vec2<uint32_t> h_range =
+                    mqi::start_and_length(total_threads, histories_in_batch, thread_id);
+                  mc::transport_histories<R>(&worker_threads[thread_id].rnd_generator,
+                                             mc::mc_world,
+                                             mc::mc_vertices,
+                                             h_range.x,
+                                             h_range.x + h_range.y,
+                                             &validation_tracked,
+                                             nullptr,
+                                             true,
+                                             &validation_buffers[size_t(thread_id) * n_scorers]);
+              },
+              n_threads);
+            for (uint32_t c_ind = 0; c_ind < mc::mc_world->n_children; c_ind++) {
+                mc::mc_world->children[c_ind]->majorant_density = majorants[c_ind];
+                mc::mc_world->children[c_ind]->geo->enable_super_voxels(true);
+            }
+        }
+        delete[] worker_threads;
+        for (uint32_t c_ind = 0; c_ind < mc::mc_world->n_children; c_ind++) {
+            mqi::node_t<R>* c_node = mc::mc_world->children[c_ind];
+            for (uint32_t s_ind = 0; s_ind < c_node->n_scorers; s_ind++) {
+                const mqi::packed_table* table = c_node->scorers[s_ind]->packed_;
+                if (!table) continue;
+                if (table->long_probes_ > 0) {
+                    printf("Scorer table: %llu deposits probed beyond %u slots\n",
+                           table->long_probes_,
+                           table->max_probe_);
+                }
+                if (table->overflow_ > 0) {
+                    printf("Scorer table full: %llu deposits of %u slots could not be stored\n",
+                           table->overflow_,
+                           table->capacity_);
+                    throw std::runtime_error("Scorer table full, deposits were lost.");
+                }
+            }
+        }
+        if (this->debug_mode) {
+            printf("Secondary track stacks: %llu reallocations, max depth %u\n",
+                   (unsigned long long) mqi::track_stack_counters.grown.load(),
+                   mqi::track_stack_counters.max_depth.load());
+        }
 #endif
     }   //run_simulation
 
+    ///< Pool sampling the vertices of a batch, shared with the CPU transport.
+    ///< Created once with all the threads; smaller jobs run on its first threads.
     CUDA_HOST
-    void
-    read_vertices_spot(size_t                                      history_start,
-                       size_t                                      history_end,
-                       std::tuple<mqi::beamlet<R>, size_t, size_t> bl,
-                       mqi::vertex_t<R>*                           vertices,
-                       uint32_t*                                   score_offset_vector,
-                       int                                         spot_ind,
-                       size_t                                      histories_per_batch) {
-        for (int history_ind = history_start; history_ind < history_end; history_ind++) {
-            vertices[history_ind] = std::get<0>(bl)(&this->beam_rng);
-
-            score_offset_vector[history_ind] =
-              spot_ind * this->scorer_size;   // Store beamlet index for each history
-            assert(history_ind < histories_per_batch);
-        }
+    mqi::thread_pool*
+    vertex_pool() {
+#if defined(__CUDACC__)
+        ///< TotalThreads counts GPU threads here
+        const uint32_t n_threads = mqi::cpu_thread_count(-1);
+#else
+        const uint32_t n_threads = mqi::cpu_thread_count(this->num_total_threads);
+#endif
+        if (!cpu_pool) cpu_pool = new mqi::thread_pool(n_threads);
+        return cpu_pool;
     }
+
     CUDA_HOST
     virtual void
     run_by_beam(mqi::node_t<R>* world = mc::mc_world) {
@@ -1537,28 +1801,189 @@ public:
             histories_per_batch = this->max_histories_per_batch;
             std::cout << "Uploading particles with batch.. : Particle count --> " << histories_per_batch << " with " << num_batches << " batches" << std::endl;
         }
+        this->vertices = new mqi::vertex_t<R>[histories_per_batch];   ///< reused by every batch
         for (int batch = 0; batch < num_batches; batch++) 
         {
-            this->vertices = new mqi::vertex_t<R>[histories_per_batch];
             printf("Generating particles for (%d of %d batches) in CPU ..\n", batch + 1, num_batches);
-            for (current_vertex = 0; current_vertex < histories_per_batch; current_vertex++) 
-            {
-                if (cum_vertices + current_vertex >= (h1 - h0)) { break; }
-                auto bl = this->beamsource(cum_vertices + current_vertex);
-                this->vertices[current_vertex] = bl(&this->beam_rng);   // copy histories to vertices
-            }
+            const size_t batch_end = std::min(cum_vertices + histories_per_batch, h1 - h0);
+            this->beamsource.sample_vertices(h0 + cum_vertices,
+                                             h0 + batch_end,
+                                             this->vertices,
+                                             this->master_seed,
+                                             this->bnb,
+                                             this->vertex_pool());
+            current_vertex = batch_end - cum_vertices;
 
             std::cout << "Particle generation complete!" << std::endl;
             cum_vertices += current_vertex;
+            this->batch_first_history = cum_vertices - current_vertex;
             printf("Transporting particles...\n");
             run_simulation(histories_per_batch, current_vertex, tracked_particles);
             std::cout << "Particle transportation complete!" << std::endl;
-            delete[] this->vertices;
             if (tracked_particles[0] == h1) { break; }
         }
-
+        delete[] this->vertices;
+        this->vertices = nullptr;
+#if !defined(__CUDACC__)
+        if (woodcock_tracking && validate_transport) this->report_transport_validation();
+#endif
     }   //run_by_beam
 
+    ///< Vertices of a batch of run_pipelined
+    struct vertex_batch_t {
+        std::vector<mqi::vertex_t<R>> vertices;
+        std::vector<uint32_t>         score_offsets;   ///< per_spot only
+        size_t                        first = 0;       ///< history of vertices[0]
+        size_t                        n     = 0;       ///< histories in the batch
+    };
+
+    ///< run_by_beam (per_spot false) or run_by_spot (true) with the vertices of
+    ///< batch N+1 generated on a second thread while batch N is transported.
+    ///< Batches are contiguous history ranges of MaxHistoriesPerBatch, as in both.
+    CUDA_HOST
+    void
+    run_pipelined(bool per_spot) {
+        const size_t h1                  = this->beamsource.total_histories();
+        const size_t histories_per_batch = (this->max_histories_per_batch > 0)
+                                             ? std::min(this->max_histories_per_batch, h1)
+                                             : h1;
+        if (histories_per_batch == 0) return;
+        const uint32_t num_batches = (h1 + histories_per_batch - 1) / histories_per_batch;
+        printf("Pipelined run.. : %lu histories per batch, %u batches\n",
+               histories_per_batch,
+               num_batches);
+
+        std::vector<vertex_batch_t> buffers(2);
+        for (vertex_batch_t& buffer : buffers) {
+            buffer.vertices.resize(histories_per_batch);
+            if (per_spot) buffer.score_offsets.resize(histories_per_batch);
+        }
+#if defined(__CUDACC__)
+        mqi::thread_pool* pool = this->vertex_pool();   ///< transport runs on the GPU
+#else
+        mqi::thread_pool* pool = nullptr;   ///< the CPU threads are transporting meanwhile
+#endif
+        uint32_t                            tracked_particles = 0;
+        mqi::batch_pipeline<vertex_batch_t> pipeline(buffers);
+        pipeline.run(
+          num_batches,
+          [&](uint32_t batch, vertex_batch_t& buffer) {
+              buffer.first = size_t(batch) * histories_per_batch;
+              buffer.n     = std::min(histories_per_batch, h1 - buffer.first);
+              this->beamsource.sample_vertices(buffer.first,
+                                               buffer.first + buffer.n,
+                                               buffer.vertices.data(),
+                                               this->master_seed,
+                                               this->bnb,
+                                               pool);
+              if (!per_spot) return;
+              this->beamsource.for_each_spot_range(
+                buffer.first,
+                buffer.first + buffer.n,
+                [&](size_t id, mqi::beamlet<R>&, size_t first, size_t last) {
+                    for (size_t h = first; h < last; h++) {
+                        buffer.score_offsets[h - buffer.first] = id * this->scorer_size;
+                    }
+                });
+          },
+          [&](uint32_t batch, vertex_batch_t& buffer) {
+              printf("Transporting particles (%u of %u batches)..\n", batch + 1, num_batches);
+              this->vertices            = buffer.vertices.data();
+              this->batch_first_history = buffer.first;
+              run_simulation(histories_per_batch,
+                             buffer.n,
+                             &tracked_particles,
+                             per_spot ? buffer.score_offsets.data() : nullptr);
+              return tracked_particles < h1;
+          });
+        this->vertices = nullptr;   ///< owned by the buffers
+        pipeline.print_stats("generation", "transport");
+#if !defined(__CUDACC__)
+        if (woodcock_tracking && validate_transport) this->report_transport_validation();
+#endif
+    }
+
+    ///< Compare the scorers (Woodcock tracking) with the voxel-by-voxel reference
+    ///< accumulated in validation_buffers, then reset the reference. A dose + LETd
+    ///< scorer is also compared by its LETd in the voxels above 10% of the maximum dose.
+    CUDA_HOST
+    void
+    report_transport_validation() {
+        const uint32_t n_scorers = mc::total_scorers(this->world);
+        if (n_scorers == 0 || validation_buffers.empty()) return;
+        const size_t n_threads = validation_buffers.size() / n_scorers;
+        for (uint32_t c_ind = 0; c_ind < this->world->n_children; c_ind++) {
+            mqi::node_t<R>*        c_node = this->world->children[c_ind];
+            const mqi::vec3<ijk_t> dim    = c_node->geo->get_nxyz();
+            const size_t           n_vox  = size_t(dim.x) * dim.y * dim.z;
+            const uint32_t         base   = mc::scorer_base_index(this->world, c_ind);
+            for (uint32_t s_ind = 0; s_ind < c_node->n_scorers; s_ind++) {
+                const mqi::scorer<R>* scr = c_node->scorers[s_ind];
+                std::vector<double>   test(n_vox, 0.0), ref(n_vox, 0.0);
+                ///< LETd numerator and denominator of each voxel of a dose + LETd scorer
+                const bool          letd = (scr->quantities_ != nullptr);
+                std::vector<double> let_test(letd ? 2 * n_vox : 0, 0.0);
+                std::vector<double> let_ref(letd ? 2 * n_vox : 0, 0.0);
+                for (uint32_t ind = 0; ind < scr->max_capacity_; ind++) {
+                    const mqi::key_value e = scr->entry(ind);
+                    if (e.key1 == mqi::empty_pair || e.key1 >= n_vox) continue;
+                    test[e.key1] += e.value;
+                    if (!letd) continue;
+                    let_test[2 * e.key1] += scr->quantity(ind, 1);
+                    let_test[2 * e.key1 + 1] += scr->quantity(ind, 2);
+                }
+                for (size_t t = 0; t < n_threads; t++) {
+                    mqi::scoring_buffer& buffer = validation_buffers[t * n_scorers + base + s_ind];
+                    const bool           with_let = letd && buffer.n_values() >= 3;
+                    buffer.for_each_values([&](mqi::key_t key1, mqi::key_t, const double* v) {
+                        if (key1 >= n_vox) return;
+                        ref[key1] += v[0];
+                        if (!with_let) return;
+                        let_ref[2 * key1] += v[1];
+                        let_ref[2 * key1 + 1] += v[2];
+                    });
+                    buffer.clear();
+                }
+                double sum_test = 0, sum_ref = 0, max_ref = 0, max_diff = 0;
+                for (size_t v = 0; v < n_vox; v++) {
+                    sum_test += test[v];
+                    sum_ref += ref[v];
+                    if (ref[v] > max_ref) max_ref = ref[v];
+                    if (std::abs(test[v] - ref[v]) > max_diff) max_diff = std::abs(test[v] - ref[v]);
+                }
+                uint32_t n_beyond = 0;
+                for (size_t v = 0; v < n_vox; v++) {
+                    if (std::abs(test[v] - ref[v]) > 0.02 * max_ref) n_beyond++;
+                }
+                printf("Transport validation (Woodcock vs Voxel) scorer %s: total ratio %f, "
+                       "max difference %.2f%% of max, %u voxels beyond 2%% of max\n",
+                       scr->name_,
+                       (sum_ref > 0) ? sum_test / sum_ref : 0.0,
+                       (max_ref > 0) ? 100.0 * max_diff / max_ref : 0.0,
+                       n_beyond);
+                if (!letd) continue;
+                double num_test = 0, den_test = 0, num_ref = 0, den_ref = 0, max_let_diff = 0;
+                for (size_t v = 0; v < n_vox; v++) {
+                    if (ref[v] < 0.1 * max_ref) continue;
+                    num_test += let_test[2 * v];
+                    den_test += let_test[2 * v + 1];
+                    num_ref += let_ref[2 * v];
+                    den_ref += let_ref[2 * v + 1];
+                    if (let_test[2 * v + 1] <= 0 || let_ref[2 * v + 1] <= 0) continue;
+                    const double ratio = (let_test[2 * v] / let_test[2 * v + 1]) /
+                                         (let_ref[2 * v] / let_ref[2 * v + 1]);
+                    if (std::abs(ratio - 1.0) > max_let_diff) max_let_diff = std::abs(ratio - 1.0);
+                }
+                printf("Transport validation (Woodcock vs Voxel) scorer %s: LETd ratio %f, "
+                       "max LETd difference %.2f%% in voxels above 10%% of max\n",
+                       scr->name_,
+                       (den_test > 0 && num_ref > 0) ? (num_test / den_test) / (num_ref / den_ref)
+                                                     : 0.0,
+                       100.0 * max_let_diff);
+            }
+        }
+    }
+
     // Change RT file based beam generation to log file based generation
     // 2023-11-01
 
@@ -1598,12 +2023,11 @@ public:
                    num_batches);
         }
 
-        mqi::vertex_t<R>* vertices_test;
+        ///< reused by every batch
+        this->vertices                = new mqi::vertex_t<R>[histories_per_batch];
+        uint32_t* score_offset_vector = new uint32_t[histories_per_batch];
         //        printf("histories per batch %d\n",histories_per_batch);
         while (spot_ind < this->num_spots) {
-            this->vertices                = new mqi::vertex_t<R>[histories_per_batch];
-            vertices_test                 = new mqi::vertex_t<R>[histories_per_batch];
-            uint32_t* score_offset_vector = new uint32_t[histories_per_batch];
             //            printf("num batches %d batch %d spot start %d\n",num_batches,batch, spot_start);
             start = std::chrono::high_resolution_clock::now();
             printf("Generating particles..\n");
@@ -1615,15 +2039,10 @@ public:
                 } else {
                     loop_end = histories_per_batch;
                 }
-                /// The multithreading gives small performance gain if we need run it for each spot
-                ///20 seconds ->  18 seconds
-                read_vertices_spot(current_vertex,
-                                   loop_end,
-                                   bl,
-                                   this->vertices,
-                                   score_offset_vector,
-                                   spot_ind,
-                                   histories_per_batch);
+                ///< vertices are sampled for the whole batch below
+                for (size_t v = current_vertex; v < loop_end; v++) {
+                    score_offset_vector[v] = spot_ind * this->scorer_size;
+                }
 
                 assert(loop_end > current_vertex);
                 current_history += loop_end - current_vertex;
@@ -1643,24 +2062,32 @@ public:
                     current_history = 0;
                 }
             }
+            this->beamsource.sample_vertices(cum_vertices - current_vertex,
+                                             cum_vertices,
+                                             this->vertices,
+                                             this->master_seed,
+                                             this->bnb,
+                                             this->vertex_pool());
             stop     = std::chrono::high_resolution_clock::now();
             duration = stop - start;
 
             //printf("beam generation %f ms\n", duration.count());
             /// Transport particles
             printf("Transporting particles..\n");
-            start = std::chrono::high_resolution_clock::now();
+            start                     = std::chrono::high_resolution_clock::now();
+            this->batch_first_history = cum_vertices - current_vertex;
             run_simulation(
               histories_per_batch, current_vertex, tracked_particles, score_offset_vector);
             stop     = std::chrono::high_resolution_clock::now();
             duration = stop - start;
             printf("run simulation %f ms\n", duration.count());
             current_vertex = 0;
-            delete[] this->vertices;
-            delete[] score_offset_vector;
             batch += 1;
             if (tracked_particles[0] == h1) { break; }
         }
+        delete[] this->vertices;
+        delete[] score_offset_vector;
+        this->vertices = nullptr;
         printf("spot ind %lu num_spots %d cum vertices %lu total histories %lu\n",
                spot_ind,
                this->num_spots,
@@ -1778,22 +2205,54 @@ public:
         }
     }
 
+    ///< Quantity q of a scorer summed per voxel (q = 0: the table value)
     CUDA_HOST
     std::vector<double>
-    reshape_data(int c_ind, int s_ind, mqi::vec3<ijk_t> dim) {
+    reshape_data(int c_ind, int s_ind, mqi::vec3<ijk_t> dim, uint8_t q = 0) {
+        const mqi::scorer<R>* scr   = this->world->children[c_ind]->scorers[s_ind];
+        const double*         dense = scr->dense_;
+        if (dense != nullptr) {
+            if (q > 0) dense = scr->quantities_ + (q - 1) * size_t(scr->max_capacity_);
+            return std::vector<double>(dense, dense + dim.x * dim.y * dim.z);
+        }
         std::vector<double> reshaped_data(dim.x * dim.y * dim.z, 0.0);
         //printf("max capacity %d\n", this->world->children[c_ind]->scorers[s_ind]->max_capacity_);
-        for (int ind = 0; ind < this->world->children[c_ind]->scorers[s_ind]->max_capacity_;
-             ind++) {
-            if (this->world->children[c_ind]->scorers[s_ind]->data_[ind].key1 != mqi::empty_pair &&
-                this->world->children[c_ind]->scorers[s_ind]->data_[ind].key2 != mqi::empty_pair) {
-                reshaped_data[this->world->children[c_ind]->scorers[s_ind]->data_[ind].key1] +=
-                  this->world->children[c_ind]->scorers[s_ind]->data_[ind].value;
+        for (int ind = 0; ind < scr->max_capacity_; ind++) {
+            const mqi::key_value e = scr->entry(ind);
+            if (e.key1 != mqi::empty_pair && e.key2 != mqi::empty_pair) {
+                reshaped_data[e.key1] += (q == 0) ? e.value : scr->quantity(ind, q);
             }
         }
         return reshaped_data;
     }
 
+    ///< LETd (keV/um in water) of a DOSE_LETD_HIT scorer, numerator over denominator
+    ///< per voxel. Written as mhd or mha when selected and as raw otherwise, since
+    ///< the dcm and npz writers carry dose.
+    CUDA_HOST
+    void
+    save_LETd_file(int c_ind, int s_ind, const std::string& beam_name) {
+        const mqi::scorer<R>* scr = this->world->children[c_ind]->scorers[s_ind];
+        if (scr->hit_ != mqi::DOSE_LETD_HIT || scr->quantities_ == nullptr) return;
+        const mqi::vec3<ijk_t> dim         = this->world->children[c_ind]->geo->get_nxyz();
+        const uint32_t         vol_size    = dim.x * dim.y * dim.z;
+        std::vector<double>    letd        = this->reshape_data(c_ind, s_ind, dim, 1);
+        std::vector<double>    denominator = this->reshape_data(c_ind, s_ind, dim, 2);
+        for (uint32_t v = 0; v < vol_size; v++) {
+            letd[v] = (denominator[v] > 0) ? letd[v] / denominator[v] : 0.0;
+        }
+        const std::string filename = beam_name + "_" + std::to_string(c_ind) + "_LETd";
+        if (!this->output_format.compare("mhd")) {
+            mqi::io::save_to_mhd<R>(
+              this->world->children[c_ind], letd.data(), 1.0, this->output_path, filename, vol_size);
+        } else if (!this->output_format.compare("mha")) {
+            mqi::io::save_to_mha<R>(
+              this->world->children[c_ind], letd.data(), 1.0, this->output_path, filename, vol_size);
+        } else {
+            mqi::io::save_to_bin<double>(letd.data(), 1.0, this->output_path, filename, vol_size);
+        }
+    }
+
     CUDA_HOST
     void
     save_reshaped_files() {
@@ -1864,6 +2323,7 @@ public:
                                                  filename,
                                                  vol_size);
                 }
+                this->save_LETd_file(c_ind, s_ind, beam_name);
             }
         }
     }
@@ -1888,6 +2348,7 @@ public:
                                         filename,
                                         dim,
                                         this->num_spots);
+                this->save_LETd_file(c_ind, s_ind, beam_name);
             }
         }
         //auto                                      stop = std::chrono::high_resolution_clock::now();
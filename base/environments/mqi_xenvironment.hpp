@@ -120,6 +120,15 @@ public:
         mc::g_debug_mode = debug_mode;
         // Copy debug mode to device constant memory
         cudaMemcpyToSymbol(mc::g_debug_mode_device, &debug_mode, sizeof(bool));
+        // Copy the interleaved cross-section table of the physics list
+        cudaMemcpyToSymbol(mqi::cs_table_device,
+                           &mqi::cross_section_table::host(),
+                           sizeof(mqi::cross_section_table));
+        check_cuda_last_error("(upload cross-section table)");
+        cudaMemcpyToSymbol(mqi::range_table_device,
+                           &mqi::inverse_range_table::host(),
+                           sizeof(mqi::inverse_range_table));
+        check_cuda_last_error("(upload inverse range table)");
 
         cudaMalloc(&mc::mc_world, sizeof(mqi::node_t<R>));
         if (debug_mode) {
@@ -173,14 +182,15 @@ public:
     CUDA_HOST
     std::vector<double>
     reshape_data(int c_ind, int s_ind, mqi::vec3<ijk_t> dim) {
+        const double* dense = this->world->children[c_ind]->scorers[s_ind]->dense_;
+        if (dense != nullptr) return std::vector<double>(dense, dense + dim.x * dim.y * dim.z);
         std::vector<double> reshaped_data(dim.x * dim.y * dim.z, 0.0);
         //printf("max capacity %d\n", this->world->children[c_ind]->scorers[s_ind]->max_capacity_);
         for (int ind = 0; ind < this->world->children[c_ind]->scorers[s_ind]->max_capacity_;
              ind++) {
-            if (this->world->children[c_ind]->scorers[s_ind]->data_[ind].key1 != mqi::empty_pair &&
-                this->world->children[c_ind]->scorers[s_ind]->data_[ind].key2 != mqi::empty_pair) {
-                reshaped_data[this->world->children[c_ind]->scorers[s_ind]->data_[ind].key1] +=
-                  this->world->children[c_ind]->scorers[s_ind]->data_[ind].value;
+            const mqi::key_value e = this->world->children[c_ind]->scorers[s_ind]->entry(ind);
+            if (e.key1 != mqi::empty_pair && e.key2 != mqi::empty_pair) {
+                reshaped_data[e.key1] += e.value;
             }
         }
         return reshaped_data;
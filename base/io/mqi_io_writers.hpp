@@ -44,12 +44,13 @@ public:
         std::vector<double> value;
 
         for (int ind = 0; ind < src->max_capacity_; ind++) {
-            if (src->data_[ind].key1 != mqi::empty_pair &&
-                src->data_[ind].key2 != mqi::empty_pair &&
-                src->data_[ind].value > 0) {
-                key1.push_back(src->data_[ind].key1);
-                key2.push_back(src->data_[ind].key2);
-                value.push_back(src->data_[ind].value * scale);
+            const mqi::key_value e = src->entry(ind);
+            if (e.key1 != mqi::empty_pair &&
+                e.key2 != mqi::empty_pair &&
+                e.value > 0) {
+                key1.push_back(e.key1);
+                key2.push_back(e.key2);
+                value.push_back(e.value * scale);
             }
         }
 
@@ -94,13 +95,14 @@ public:
         std::vector<mqi::key_t>* vox_vec = new std::vector<mqi::key_t>[num_spots];
 
         for (int ind = 0; ind < src->max_capacity_; ind++) {
-            if (src->data_[ind].key1 != mqi::empty_pair &&
-                src->data_[ind].key2 != mqi::empty_pair) {
-                mqi::key_t vox_ind = src->data_[ind].key1;
-                mqi::key_t spot_ind = src->data_[ind].key2;
+            const mqi::key_value e = src->entry(ind);
+            if (e.key1 != mqi::empty_pair &&
+                e.key2 != mqi::empty_pair) {
+                mqi::key_t vox_ind = e.key1;
+                mqi::key_t spot_ind = e.key2;
 
                 if (vox_ind >= 0 && vox_ind < vol_size) {
-                    value_vec[spot_ind].push_back(src->data_[ind].value * scale);
+                    value_vec[spot_ind].push_back(e.value * scale);
                     vox_vec[spot_ind].push_back(vox_ind);
                 }
             }
@@ -160,13 +162,14 @@ public:
         std::vector<mqi::key_t>* vox_vec = new std::vector<mqi::key_t>[num_spots];
 
         for (int ind = 0; ind < src->max_capacity_; ind++) {
-            if (src->data_[ind].key1 != mqi::empty_pair &&
-                src->data_[ind].key2 != mqi::empty_pair) {
-                mqi::key_t vox_ind = src->data_[ind].key1;
-                mqi::key_t spot_ind = src->data_[ind].key2;
+            const mqi::key_value e = src->entry(ind);
+            if (e.key1 != mqi::empty_pair &&
+                e.key2 != mqi::empty_pair) {
+                mqi::key_t vox_ind = e.key1;
+                mqi::key_t spot_ind = e.key2;
 
                 if (vox_ind >= 0 && vox_ind < vol_size) {
-                    double value = src->data_[ind].value;
+                    double value = e.value;
                     value *= scale;
                     value -= 2 * threshold;
                     if (value < 0) value = 0;
@@ -249,16 +252,17 @@ public:
 
         printf("scan start %d\n", src->max_capacity_);
         for (int ind = 0; ind < src->max_capacity_; ind++) {
-            if (src->data_[ind].key1 != mqi::empty_pair && src->data_[ind].key2 != mqi::empty_pair) {
-                vox_ind = src->data_[ind].key1;
+            const mqi::key_value e = src->entry(ind);
+            if (e.key1 != mqi::empty_pair && e.key2 != mqi::empty_pair) {
+                vox_ind = e.key1;
                 vox_ind = src->roi_->get_mask_idx(vox_ind);
                 if (vox_ind < 0) {
                     printf("is this right?\n");
                     continue;
                 }
-                spot_ind = src->data_[ind].key2;
+                spot_ind = e.key2;
                 assert(vox_ind >= 0 && vox_ind < vol_size);
-                value = src->data_[ind].value;
+                value = e.value;
                 assert(value > 0);
                 value_vec[vox_ind].push_back(value * scale);
                 spot_vec[vox_ind].push_back(spot_ind);
@@ -434,13 +438,14 @@ void DicomWriter<R>::save_from_scorer(
     std::vector<double> dose_data(actual_size, 0.0);
 
     for (int ind = 0; ind < src->max_capacity_; ind++) {
-        if (src->data_[ind].key1 != mqi::empty_pair &&
-            src->data_[ind].key2 != mqi::empty_pair &&
-            src->data_[ind].value > 0) {
+        const mqi::key_value e = src->entry(ind);
+        if (e.key1 != mqi::empty_pair &&
+            e.key2 != mqi::empty_pair &&
+            e.value > 0) {
 
-            mqi::key_t key = src->data_[ind].key1;
+            mqi::key_t key = e.key1;
             if (key < actual_size) {
-                dose_data[key] += src->data_[ind].value * scale;
+                dose_data[key] += e.value * scale;
             }
         }
     }
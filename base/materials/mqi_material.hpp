@@ -5,6 +5,7 @@
 #include <moqui/base/mqi_math.hpp>
 #include <moqui/base/mqi_physics_constants.hpp>
 #include "moqui/base/materials/material_table_data.hpp"
+#include <moqui/base/materials/mqi_spr_table.hpp>
 
 #include <cmath>
 #include <cstdlib>
@@ -84,24 +85,10 @@ public:
     stopping_power_ratio(R Ek, int8_t id = -1) {
         ////< 0.9 g/cm^3 ->  g/mm^3
         R density_tmp = this->rho_mass * 1000.0;
-
-      if (density_tmp > 0.26)
-        {
-            R rsp = 1.0123 - 3.386e-5 * Ek;
-            rsp += 0.291 * (1.0 + mqi::mqi_pow(Ek, static_cast<R>(-0.3421))) *
-                        (mqi::mqi_pow(density_tmp, static_cast<R>(-0.7)) - 1.0);
-                        
-            if (density_tmp > 0.9) return 1.0;
-            else return mqi::intpl1d<R>(density_tmp, 0.26, 0.9, 0.9925, rsp);
-        }
-        else 
-        {
-            if (density_tmp < 0.0012) {
-                return 0.0;
-            } else {
-                return mqi::intpl1d<R>(density_tmp, 0.0012, 0.26, 0.8815, 0.9925);
-            }
-        }
+#if !defined(__CUDACC__)
+        if (mqi::spr_table.enabled) return mqi::spr_table.lookup(density_tmp, Ek);
+#endif
+        return mqi::spr_exact<R>(density_tmp, Ek);
     }
 
     ///< variable density
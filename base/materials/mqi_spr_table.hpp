@@ -0,0 +1,105 @@
+#ifndef MQI_SPR_TABLE_HPP
+#define MQI_SPR_TABLE_HPP
+
+/// \file
+///
+/// Stopping power ratio (to water) of the density-scaled patient materials.
+///
+/// spr_exact() is the analytic model used by material_t. It only depends on the
+/// energy between 0.26 and 0.9 g/cm^3, where it needs two powers per call; this
+/// range is tabulated once at startup in spr_table_t (float, one energy row per
+/// density bin, ~200 KB) so a lookup is two index calculations and a bilinear
+/// interpolation. Outside the tabulated range the analytic model is cheap and is
+/// used as is. The table is a CPU feature; the GPU keeps spr_exact().
+
+#include <moqui/base/mqi_common.hpp>
+#include <moqui/base/mqi_math.hpp>
+
+namespace mqi
+{
+
+///< Stopping power ratio for a density (g/cm^3) and a kinetic energy (MeV)
+template<typename R>
+CUDA_DEVICE inline R
+spr_exact(R density, R Ek) {
+    if (density > 0.26) {
+        if (density > 0.9) return 1.0;
+        R rsp = 1.0123 - 3.386e-5 * Ek;
+        rsp += 0.291 * (1.0 + mqi::mqi_pow(Ek, static_cast<R>(-0.3421))) *
+               (mqi::mqi_pow(density, static_cast<R>(-0.7)) - 1.0);
+        return mqi::intpl1d<R>(density, 0.26, 0.9, 0.9925, rsp);
+    } else {
+        if (density < 0.0012) return 0.0;
+        return mqi::intpl1d<R>(density, 0.0012, 0.26, 0.8815, 0.9925);
+    }
+}
+
+#if !defined(__CUDACC__)
+/// \class spr_table_t
+/// Density x energy table of spr_exact over its energy dependent range.
+/// The model varies as Ek^-0.34, fastest below e_fine where the Bragg peak
+/// deposits, so the energy axis has 0.1 MeV bins up to e_fine and 1 MeV bins
+/// above; both are uniform, so a lookup needs no log.
+class spr_table_t
+{
+public:
+    static constexpr float rho_min = 0.26f;
+    static constexpr float rho_max = 0.9f;
+    static constexpr int   n_rho   = 129;   ///< 0.005 g/cm^3 bins
+    static constexpr float e_min   = 1.0f;
+    static constexpr float e_fine  = 10.0f;   ///< end of the fine energy bins
+    static constexpr float e_max   = 300.0f;
+    static constexpr int   n_fine  = 90;    ///< 0.1 MeV bins from e_min to e_fine
+    static constexpr int   n_e     = n_fine + 291;   ///< then 1 MeV bins to e_max
+
+    bool  enabled = false;     ///< material_t uses lookup() instead of spr_exact()
+    float data[n_rho * n_e];   ///< data[i_rho * n_e + i_e]
+
+    ///< Energy of column j
+    static double
+    energy(int j) {
+        if (j <= n_fine) return e_min + j * (double(e_fine) - e_min) / n_fine;
+        return e_fine + (j - n_fine);
+    }
+
+    ///< Tabulate spr_exact and enable the table
+    void
+    build() {
+        const double d_rho = (double(rho_max) - rho_min) / (n_rho - 1);
+        for (int i = 0; i < n_rho; ++i) {
+            for (int j = 0; j < n_e; ++j) {
+                data[i * n_e + j] = float(spr_exact<double>(rho_min + i * d_rho, energy(j)));
+            }
+        }
+        enabled = true;
+    }
+
+    ///< Bilinear interpolation in the table, spr_exact outside of it
+    float
+    lookup(float density, float Ek) const {
+        if (density <= rho_min || density > rho_max || Ek < e_min || Ek >= e_max) {
+            return spr_exact<float>(density, Ek);
+        }
+        const float x = (density - rho_min) * ((n_rho - 1) / (rho_max - rho_min));
+        const float y = (Ek < e_fine) ? (Ek - e_min) * (n_fine / (e_fine - e_min))
+                                      : n_fine + (Ek - e_fine);
+        int         i = int(x);
+        int         j = int(y);
+        if (i > n_rho - 2) i = n_rho - 2;
+        if (j > n_e - 2) j = n_e - 2;
+        const float  fx  = x - i;
+        const float  fy  = y - j;
+        const float* row = data + i * n_e + j;
+        const float  lo  = row[0] + fy * (row[1] - row[0]);
+        const float  hi  = row[n_e] + fy * (row[n_e + 1] - row[n_e]);
+        return lo + fx * (hi - lo);
+    }
+};
+
+///< Process-wide table, built by the environment (StoppingPowerRatio Table)
+inline spr_table_t spr_table;
+#endif
+
+}   // namespace mqi
+
+#endif
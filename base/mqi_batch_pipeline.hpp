@@ -0,0 +1,212 @@
+#ifndef MQI_BATCH_PIPELINE_HPP
+#define MQI_BATCH_PIPELINE_HPP
+
+/// \file
+///
+/// Two-stage pipeline between the vertex generation and the transport of batches.
+///
+/// A producer thread fills batch N+1 while the calling thread consumes batch N.
+/// The buffers are allocated once by the caller and circulate through two
+/// bounded queues: empty buffers go to the producer, filled ones to the
+/// consumer. The producer therefore runs at most (buffers - 1) batches ahead, and
+/// the time to fill a batch is hidden behind the time to consume the previous one.
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <moqui/base/mqi_common.hpp>
+
+namespace mqi
+{
+
+/// \class bounded_queue
+///
+/// FIFO of at most capacity elements. push blocks while it is full and pop
+/// while it is empty; close releases both and makes pop fail once it is empty.
+template<class T>
+class bounded_queue
+{
+public:
+    CUDA_HOST
+    explicit bounded_queue(size_t capacity) : capacity_(capacity > 0 ? capacity : 1) {
+        ;
+    }
+
+    ///< Returns false when the queue was closed instead
+    CUDA_HOST
+    bool
+    push(const T& item) {
+        std::unique_lock<std::mutex> lock(mtx_);
+        cv_not_full_.wait(lock, [this] { return closed_ || items_.size() < capacity_; });
+        if (closed_) return false;
+        items_.push_back(item);
+        cv_not_empty_.notify_one();
+        return true;
+    }
+
+    ///< Returns false when the queue is closed and empty
+    CUDA_HOST
+    bool
+    pop(T& item) {
+        std::unique_lock<std::mutex> lock(mtx_);
+        cv_not_empty_.wait(lock, [this] { return closed_ || !items_.empty(); });
+        if (items_.empty()) return false;
+        item = items_.front();
+        items_.pop_front();
+        cv_not_full_.notify_one();
+        return true;
+    }
+
+    CUDA_HOST
+    void
+    close() {
+        std::lock_guard<std::mutex> lock(mtx_);
+        closed_ = true;
+        cv_not_full_.notify_all();
+        cv_not_empty_.notify_all();
+    }
+
+private:
+    const size_t            capacity_;
+    std::deque<T>           items_;
+    std::mutex              mtx_;
+    std::condition_variable cv_not_full_;
+    std::condition_variable cv_not_empty_;
+    bool                    closed_ = false;
+};
+
+///< Timing of a stage of the last run
+struct pipeline_stage_stats_t {
+    uint32_t batches = 0;     ///< batches processed
+    double   busy_ms = 0.0;   ///< time spent in the stage function
+    double   wait_ms = 0.0;   ///< time spent waiting for a buffer
+};
+
+/// \class batch_pipeline
+///
+/// Runs produce(batch, buffer) on a thread of its own and consume(batch, buffer)
+/// on the calling thread, in batch order, over the buffers given at construction.
+/// An exception of either stage stops both; run rethrows it after the join.
+/// \tparam B buffer type
+template<class B>
+class batch_pipeline
+{
+public:
+    ///< stage signatures: (batch, buffer); consume returns false to stop early
+    typedef std::function<void(uint32_t, B&)> produce_t;
+    typedef std::function<bool(uint32_t, B&)> consume_t;
+
+    CUDA_HOST
+    explicit batch_pipeline(std::vector<B>& buffers) : buffers_(buffers) {
+        ;
+    }
+
+    ///< Process n_batches and return the number of batches consumed.
+    ///< Rethrows the first exception of the consumer, else of the producer.
+    CUDA_HOST
+    uint32_t
+    run(uint32_t n_batches, const produce_t& produce, const consume_t& consume) {
+        typedef std::chrono::steady_clock clock_t;
+        bounded_queue<uint32_t> empty(buffers_.size());   ///< buffer indices
+        bounded_queue<uint32_t> filled(buffers_.size());
+        for (uint32_t b = 0; b < buffers_.size(); ++b)
+            empty.push(b);
+        producer_ = pipeline_stage_stats_t();
+        consumer_ = pipeline_stage_stats_t();
+        std::exception_ptr producer_error, consumer_error;
+
+        std::thread producer([&] {
+            uint32_t b;
+            try {
+                for (uint32_t batch = 0; batch < n_batches; ++batch) {
+                    auto t0 = clock_t::now();
+                    if (!empty.pop(b)) break;
+                    auto t1 = clock_t::now();
+                    produce(batch, buffers_[b]);
+                    auto t2 = clock_t::now();
+                    producer_.wait_ms +=
+                      std::chrono::duration<double, std::milli>(t1 - t0).count();
+                    producer_.busy_ms +=
+                      std::chrono::duration<double, std::milli>(t2 - t1).count();
+                    producer_.batches += 1;
+                    if (!filled.push(b)) break;
+                }
+            } catch (...) {
+                producer_error = std::current_exception();
+            }
+            ///< the consumer takes the batches filled so far, then stops
+            filled.close();
+        });
+
+        uint32_t b;
+        try {
+            for (uint32_t batch = 0; batch < n_batches; ++batch) {
+                auto t0 = clock_t::now();
+                if (!filled.pop(b)) break;
+                auto       t1   = clock_t::now();
+                const bool more = consume(batch, buffers_[b]);
+                auto       t2   = clock_t::now();
+                consumer_.wait_ms += std::chrono::duration<double, std::milli>(t1 - t0).count();
+                consumer_.busy_ms += std::chrono::duration<double, std::milli>(t2 - t1).count();
+                consumer_.batches += 1;
+                if (!more) break;
+                empty.push(b);
+            }
+        } catch (...) {
+            consumer_error = std::current_exception();
+        }
+        ///< release a producer waiting for a buffer after an early stop or an error
+        empty.close();
+        filled.close();
+        producer.join();
+        if (consumer_error) std::rethrow_exception(consumer_error);
+        if (producer_error) std::rethrow_exception(producer_error);
+        return consumer_.batches;
+    }
+
+    ///< Statistics of the last run
+    CUDA_HOST
+    const pipeline_stage_stats_t&
+    producer_stats() const {
+        return producer_;
+    }
+
+    CUDA_HOST
+    const pipeline_stage_stats_t&
+    consumer_stats() const {
+        return consumer_;
+    }
+
+    ///< Print the time of both stages of the last run
+    CUDA_HOST
+    void
+    print_stats(const char* producer_name, const char* consumer_name) const {
+        printf("Batch pipeline.. : %s %u batches, busy %.1f ms, waiting %.1f ms\n",
+               producer_name,
+               producer_.batches,
+               producer_.busy_ms,
+               producer_.wait_ms);
+        printf("Batch pipeline.. : %s %u batches, busy %.1f ms, waiting %.1f ms\n",
+               consumer_name,
+               consumer_.batches,
+               consumer_.busy_ms,
+               consumer_.wait_ms);
+    }
+
+private:
+    std::vector<B>&        buffers_;
+    pipeline_stage_stats_t producer_;
+    pipeline_stage_stats_t consumer_;
+};
+
+}   // namespace mqi
+
+#endif
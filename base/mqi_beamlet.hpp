@@ -73,12 +73,19 @@ public:
         p_coord = p;
     }
 
+    /// Returns the coordinate transform of the beamlet
+    CUDA_HOST_DEVICE
+    const coordinate_transform<T>&
+    get_coordinate_transform() const {
+        return p_coord;
+    }
+
     /// Samples energy, position, direction of a history
     /// \param no
     /// \return a tuple of energy, position(vec3), direction (vec3)
     //    CUDA_HOST_DEVICE
     virtual mqi::vertex_t<T>
-    operator()(std::default_random_engine* rng) {
+    operator()(mqi::philox4x32* rng) {
         std::array<T, 6> phsp = (*fluence)(rng);
         mqi::vec3<T>     pos(phsp[0], phsp[1], phsp[2]);
         mqi::vec3<T>     dir(phsp[3], phsp[4], phsp[5]);
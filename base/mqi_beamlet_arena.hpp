@@ -0,0 +1,132 @@
+#ifndef MQI_BEAMLET_ARENA_HPP
+#define MQI_BEAMLET_ARENA_HPP
+
+/// \file
+///
+/// Ray beamlets of a beam, stored by value.
+///
+/// The log-file machines describe each spot by a normal energy spread and a
+/// phsp_6d_ray fluence. Allocating the two on the heap per spot leaked them and
+/// scattered tens of thousands of small objects. The arena of a beam keeps them in
+/// deques, whose elements do not move, so the beamlets can point to them. For the
+/// batch sampler it also keeps the spot parameters, reduced to what a sample
+/// needs, in one array per parameter. sample() fills the vertices of a run of
+/// histories of a spot without virtual calls. It draws the same random numbers
+/// as beamlet::operator() and agrees with it up to rounding.
+
+#include <cmath>
+#include <deque>
+#include <random>
+#include <vector>
+
+#include <moqui/base/distributions/mqi_norm_1d.hpp>
+#include <moqui/base/distributions/mqi_phsp6d_ray.hpp>
+#include <moqui/base/mqi_beamlet.hpp>
+
+namespace mqi
+{
+
+/// \class beamlet_arena
+/// \tparam T for types for return values by the distributions
+template<typename T>
+class beamlet_arena
+{
+public:
+    std::deque<mqi::norm_1d<T>>     energies;   ///< distributions the beamlets point to
+    std::deque<mqi::phsp_6d_ray<T>> fluences;
+
+    ///< Spot parameters for sample(), one element per spot
+    std::vector<T> e_mean, e_sigma;             ///< energy
+    std::vector<T> x, y, z;                     ///< mean position
+    std::vector<T> dir_x, dir_y, dir_z;         ///< mean direction
+    std::vector<T> sigma_x, sigma_y, sigma_z;   ///< spread of the position
+    std::vector<T> slope_x, slope_y;            ///< direction change per unit of position
+    std::vector<T> theta_x, theta_y;            ///< angular spread around the ray
+
+    ///< Number of spots
+    size_t
+    size() const {
+        return e_mean.size();
+    }
+
+    ///< Add a spot with the parameters of norm_1d and phsp_6d_ray
+    ///< \return a beamlet pointing to the distributions of the arena
+    mqi::beamlet<T>
+    append(T                e,
+           T                e_spread,
+           std::array<T, 6> mean,
+           std::array<T, 6> sigma,
+           std::array<T, 2> rho,
+           float            source_position) {
+        energies.emplace_back(std::array<T, 1>{ e }, std::array<T, 1>{ e_spread });
+        fluences.emplace_back(mean, sigma, rho, source_position);
+
+        e_mean.push_back(e);
+        e_sigma.push_back(e_spread);
+        x.push_back(mean[0]);
+        y.push_back(mean[1]);
+        z.push_back(mean[2]);
+        dir_x.push_back(mean[3]);
+        dir_y.push_back(mean[4]);
+        dir_z.push_back(mean[5]);
+        sigma_z.push_back(sigma[2]);
+        ///< phsp_6d_ray: position variance A2 and covariance A1 at the source position
+        const T src = source_position;
+        for (int a = 0; a < 2; ++a) {
+            const T A0    = rho[a] * rho[a];
+            const T A1    = sigma[3 + a] + A0 * src;
+            const T A2    = sigma[a] * sigma[a] + 2 * sigma[3 + a] * src + A0 * src * src;
+            T       th20  = 2 * A0;
+            T       slope = 0;
+            if (A2 > 0.0) {
+                slope = A1 / std::sqrt(A2);
+                th20 -= 2.0 * A1 * A1 / A2;
+            }
+            (a == 0 ? sigma_x : sigma_y).push_back(std::sqrt(A2));
+            (a == 0 ? slope_x : slope_y).push_back(slope);
+            (a == 0 ? theta_x : theta_y).push_back(std::sqrt(th20 / 2));
+        }
+        return mqi::beamlet<T>(&energies.back(), &fluences.back());
+    }
+
+    ///< Sample n vertices of spot i, mapped by p, to v.
+    ///< \param rng keyed engine; vertex k draws from the vertex stream of history h + k
+    void
+    sample(size_t                              i,
+           const mqi::coordinate_transform<T>& p,
+           size_t                              n,
+           mqi::vertex_t<T>*                   v,
+           mqi::philox4x32*                    rng,
+           size_t                              h) const {
+        const T sx = sigma_x[i], sy = sigma_y[i], sz = sigma_z[i];
+        const T kx = slope_x[i], ky = slope_y[i];
+        const T tx = theta_x[i], ty = theta_y[i];
+        for (size_t k = 0; k < n; ++k) {
+            rng->stream(i, h + k, mqi::philox4x32::VERTEX_BLOCK);
+            ///< a new distribution per history, as in beamlet::operator()
+            std::normal_distribution<T> func(0, 1);
+
+            const T Ux = func(*rng);
+            const T Vx = func(*rng);
+            const T Uy = func(*rng);
+            const T Vy = func(*rng);
+            const T Uz = func(*rng);
+
+            mqi::vec3<T> pos(x[i] + sx * Ux, y[i] + sy * Uy, z[i] + sz * Uz);
+            mqi::vec3<T> dir(dir_x[i] + kx * Ux, dir_y[i] + ky * Uy, dir_z[i]);
+            dir.normalize();
+            dir.x = dir.x * std::cos(Vx * tx) + std::sqrt(1 - dir.x * dir.x) * std::sin(Vx * tx);
+            dir.y = dir.y * std::cos(Vy * ty) + std::sqrt(1 - dir.y * dir.y) * std::sin(Vy * ty);
+            dir.z = -1.0 * std::sqrt(1.0 - dir.x * dir.x - dir.y * dir.y);
+
+            std::normal_distribution<T> energy(e_mean[i], e_sigma[i]);
+            v[k].ke  = energy(*rng);
+            v[k].pos = p.rotation * pos + p.translation;
+            v[k].dir = p.rotation * dir;
+        }
+    }
+};
+
+}   // namespace mqi
+
+#endif
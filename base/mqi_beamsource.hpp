@@ -4,8 +4,13 @@
 /// \file
 ///
 /// A beamsource is a collection of beamlets and provides an interface for sampling.
+#include <algorithm>
 #include <map>
+#include <memory>
 #include <moqui/base/mqi_beamlet.hpp>
+#include <moqui/base/mqi_beamlet_arena.hpp>
+#include <moqui/base/mqi_philox.hpp>
+#include <moqui/base/mqi_thread_pool.hpp>
 
 namespace mqi
 {
@@ -22,13 +27,17 @@ public:
     /// Each element is a tuple of beamlet, number of histories, and accumlated histories
     std::vector<std::tuple<mqi::beamlet<T>, size_t, size_t>> beamlets_;
 
-    /// A lookup table to map a history to beamlet id.
-    /// note: To run GPU, this std::map needs to be replaced GPU compatible data structure.
-    std::map<size_t, size_t> cdf2beamlet_;
-    size_t*                  array_cdf_;
-    size_t*                  array_beamlet_;
-    size_t                   beamlet_size_;
-    mqi::beamlet<T>*         array_beamlets;
+    /// Accumulated histories of the beamlets, contiguous and sorted:
+    /// beamlet i takes the histories [cdf_[i - 1], cdf_[i]).
+    std::vector<size_t> cdf_;
+    /// Device copies of cdf_ and of the beamlet ids (see upload_beamsource)
+    size_t*          array_cdf_     = nullptr;
+    size_t*          array_beamlet_ = nullptr;
+    size_t           beamlet_size_  = 0;
+    mqi::beamlet<T>* array_beamlets = nullptr;
+    /// Spots stored by value (see beamlet_arena), shared by the copies of the
+    /// beamsource. When it holds every beamlet, sample_vertices samples from it.
+    std::shared_ptr<mqi::beamlet_arena<T>> arena_;
     /// A lookup table to map a time to beamlet id.
     //time,  beamlet_id
     //beamlet_id is -1 for no beam pulse
@@ -38,7 +47,7 @@ public:
     beamsource() {
         beamlets_.clear();
         timeline_.clear();
-        cdf2beamlet_.clear();
+        cdf_.clear();
     }
 
     /// Add a beamlet to internal containers
@@ -67,7 +76,7 @@ public:
 
         const size_t acc = total_histories() + h;
         const size_t beamlet_id = this->total_beamlets();   //current number of beamlets -> beamlet ID
-        cdf2beamlet_.insert(std::make_pair(acc, beamlet_id));
+        cdf_.push_back(acc);
         beamlets_.push_back(std::make_tuple(b, h, acc));
 
         T acc_time = this->total_delivery_time() + logfileTime;
@@ -82,7 +91,7 @@ public:
         const size_t acc = total_histories() + h;
         const size_t beamlet_id =
           this->total_beamlets();   //current number of beamlets -> beamlet ID
-        cdf2beamlet_.insert(std::make_pair(acc, beamlet_id));
+        cdf_.push_back(acc);
         beamlets_.push_back(std::make_tuple(b, h, acc));
 
         T acc_time = this->total_delivery_time() + time_on;
@@ -122,12 +131,73 @@ public:
         return beamlets_[i];
     }
 
+    /// Returns the beamlet id of a history
+    /// \return index of the first beamlet whose accumulated histories exceed h
+    size_t
+    beamlet_id(size_t h) const {
+        return std::upper_bound(cdf_.begin(), cdf_.end(), h) - cdf_.begin();
+    }
+
     /// Returns a beamlet of a history
     /// \return a beamlet reference (const)
     const mqi::beamlet<T>&
     operator()(size_t h) {
-        size_t beamlet_id = cdf2beamlet_.upper_bound(h)->second;
-        return std::get<0>(beamlets_[beamlet_id]);
+        return std::get<0>(beamlets_[this->beamlet_id(h)]);
+    }
+
+    /// Visits the beamlets of the histories [h_begin, h_end) in order.
+    /// \param f called as f(beamlet_id, beamlet, first, last) with the histories
+    ///          [first, last) of the beamlet in the range; beamlets without
+    ///          histories are skipped. Only the first beamlet is searched.
+    template<class F>
+    void
+    for_each_spot_range(size_t h_begin, size_t h_end, F f) {
+        size_t h = h_begin;
+        for (size_t id = this->beamlet_id(h_begin); h < h_end && id < cdf_.size(); ++id) {
+            const size_t last = std::min(cdf_[id], h_end);
+            if (last <= h) continue;
+            f(id, std::get<0>(beamlets_[id]), h, last);
+            h = last;
+        }
+    }
+
+    /// Samples the vertices of the histories [h_begin, h_end) to v[h - h_begin].
+    /// Each history draws from its philox stream (spot, h) at VERTEX_BLOCK, so the
+    /// vertices depend neither on the number of threads nor on the batches.
+    /// Spots of the arena are sampled by beamlet_arena::sample.
+    /// \param pool splits the range evenly over its threads, serial when null
+    void
+    sample_vertices(size_t            h_begin,
+                    size_t            h_end,
+                    mqi::vertex_t<T>* v,
+                    uint32_t          seed,
+                    uint32_t          beam,
+                    mqi::thread_pool* pool = nullptr) {
+        const bool use_arena = arena_ && arena_->size() == cdf_.size();
+
+        auto job = [&](uint32_t thread_id, uint32_t n_threads) {
+            const size_t n     = h_end - h_begin;
+            const size_t first = h_begin + n * thread_id / n_threads;
+            const size_t last  = h_begin + n * (thread_id + 1) / n_threads;
+            mqi::philox4x32 rng(seed, beam);
+            this->for_each_spot_range(
+              first, last, [&](size_t id, mqi::beamlet<T>& bl, size_t f, size_t l) {
+                  if (use_arena) {
+                      arena_->sample(
+                        id, bl.get_coordinate_transform(), l - f, v + (f - h_begin), &rng, f);
+                      return;
+                  }
+                  for (size_t h = f; h < l; ++h) {
+                      rng.stream(id, h, mqi::philox4x32::VERTEX_BLOCK);
+                      v[h - h_begin] = bl(&rng);
+                  }
+              });
+        };
+        if (pool) {
+            pool->run(job);
+        } else {
+            job(0, 1);
+        }
     }
 
     /// Calculate number of accumulated histories up to given time
@@ -63,7 +63,7 @@ const key_t      empty_pair = 0xffffffff;
 ///< XP, XM : a YZ plane at (XP)lus and (XM)inus : 1st axis
 ///< YP, YM : a YZ plane at (YP)lus and (YM)inus : 2nd axis
 ///< ZP, ZM : a YZ plane at (ZP)lus and (ZM)inus : 3rd axis
-typedef enum
+typedef enum : uint8_t
 {
     XM             = 0,
     XP             = 1,
@@ -87,7 +87,7 @@ typedef enum
     PER_PATIENT = 2
 } sim_type_t;
 
-typedef enum
+typedef enum : uint8_t
 {
     APERTURE_CLOSE = 1,
     APERTURE_OPEN  = 2,
@@ -0,0 +1,123 @@
+#ifndef MQI_CROSS_SECTION_TABLE_HPP
+#define MQI_CROSS_SECTION_TABLE_HPP
+
+/// \file
+///
+/// Interleaved cross-sections of the four proton processes of fippel_physics.
+///
+/// Each process keeps its own 0.5 MeV table and cross_section() finds its bin,
+/// checks its range and interpolates on its own. Here the four tables are merged
+/// on a common 0.1 MeV grid, on which the nodes and range limits of all of them
+/// fall, so one bin computation serves the four processes. A bin stores the four
+/// values at its lower edge followed by the four slopes across it (32 bytes), and
+/// reproduces the original piecewise-linear tables.
+///
+/// The host table is built on first use; CUDA builds copy it to cs_table_device
+/// (see x_environment::initialize).
+
+#include <moqui/base/mqi_p_ionization.hpp>
+#include <moqui/base/mqi_po_elastic.hpp>
+#include <moqui/base/mqi_po_inelastic.hpp>
+#include <moqui/base/mqi_pp_elastic.hpp>
+
+namespace mqi
+{
+
+/// \class cross_section_table
+class cross_section_table
+{
+public:
+    static constexpr float    Ek_min      = 0.1;   ///< lowest energy of the tables (MeV)
+    static constexpr float    Ek_max      = 300.0;
+    static constexpr float    dEk         = 0.1;
+    static constexpr uint16_t n_bins      = 2999;
+    static constexpr uint16_t n_processes = 4;   ///< p_ion, pp_e, po_e, po_i
+
+    float data[n_bins * 2 * n_processes];   ///< per bin: 4 lower-edge values, 4 increments
+
+    ///< Cross-sections (mm^-1) of the four processes at Ek for a density rho_mass
+    CUDA_HOST_DEVICE
+    inline void
+    cross_sections(float Ek, float rho_mass, float* cs) const {
+        if (Ek >= Ek_min && Ek <= Ek_max) {
+            const float x   = (Ek - Ek_min) * (1 / dEk);
+            uint16_t    idx = uint16_t(x);
+            if (idx >= n_bins) idx = n_bins - 1;
+            const float  t   = x - idx;
+            const float* bin = data + idx * 2 * n_processes;
+            for (uint16_t p = 0; p < n_processes; ++p) {
+                cs[p] = (bin[p] + t * bin[n_processes + p]) * rho_mass;
+            }
+        } else {
+            for (uint16_t p = 0; p < n_processes; ++p) {
+                cs[p] = 0;
+            }
+        }
+    }
+
+    ///< Tabulate the processes. They are linear inside a bin, so the two
+    ///< samples at 1/4 and 3/4 of it give the values at its edges.
+    template<typename R>
+    CUDA_HOST void
+    build(p_ionization_tabulated<R>& p_ion,
+          pp_elastic_tabulated<R>&   pp_e,
+          po_elastic_tabulated<R>&   po_e,
+          po_inelastic_tabulated<R>& po_i) {
+        h2o_t<R> unit;
+        unit.rho_mass = 1.0;
+        interaction<R, mqi::PROTON>* processes[n_processes] = { &p_ion, &pp_e, &po_e, &po_i };
+        for (uint16_t idx = 0; idx < n_bins; ++idx) {
+            const double lo = double(Ek_min) + idx * double(dEk);
+            relativistic_quantities<R> rel1(lo + 0.25 * dEk, unit.units.Mp);
+            relativistic_quantities<R> rel3(lo + 0.75 * dEk, unit.units.Mp);
+            float*                     bin = data + idx * 2 * n_processes;
+            for (uint16_t p = 0; p < n_processes; ++p) {
+                const double cs1     = processes[p]->cross_section(rel1, unit);
+                const double cs3     = processes[p]->cross_section(rel3, unit);
+                bin[p]               = float(1.5 * cs1 - 0.5 * cs3);
+                bin[n_processes + p] = float(2.0 * (cs3 - cs1));
+            }
+        }
+    }
+
+    ///< Host copy, built once from the tables used by fippel_physics
+    CUDA_HOST
+    static const cross_section_table&
+    host() {
+        static const cross_section_table table = [] {
+            cross_section_table                t;
+            mqi::p_ionization_tabulated<float> p_ion(0.1,
+                                                     299.6,
+                                                     0.5,
+                                                     mqi::cs_p_ion_table,
+                                                     mqi::restricted_stopping_power_table,
+                                                     mqi::range_steps);
+            mqi::pp_elastic_tabulated<float>   pp_e(0.5, 300.0, 0.5, mqi::cs_pp_e_g4_table);
+            mqi::po_elastic_tabulated<float>   po_e(0.5, 300.0, 0.5, mqi::cs_po_e_g4_table);
+            mqi::po_inelastic_tabulated<float> po_i(0.5, 300.0, 0.5, mqi::cs_po_i_g4_table);
+            t.build(p_ion, pp_e, po_e, po_i);
+            return t;
+        }();
+        return table;
+    }
+};
+
+#if defined(__CUDACC__)
+///< Device copy of cross_section_table::host()
+static __device__ cross_section_table cs_table_device;
+#endif
+
+///< Table for the side of the code calling it
+CUDA_HOST_DEVICE
+inline const cross_section_table*
+cross_sections_table() {
+#if defined(__CUDA_ARCH__)
+    return &cs_table_device;
+#else
+    return &cross_section_table::host();
+#endif
+}
+
+}   // namespace mqi
+
+#endif
@@ -199,6 +199,12 @@ public:
                 }
             }
         }
+        if (ind_started) {
+            ///< close a run reaching the last pixel
+            acc_stride_tmp = (acc_stride_vec.size() > 0) ? acc_stride_vec.back() : 0;
+            stride_vec.push_back(original_size - start_vec.back());
+            acc_stride_vec.push_back(acc_stride_tmp + stride_vec.back());
+        }
         uint32_t* start      = new uint32_t[start_vec.size()];
         uint32_t* stride     = new uint32_t[start_vec.size()];
         uint32_t* acc_stride = new uint32_t[acc_stride_vec.size()];
@@ -209,6 +215,7 @@ public:
         length = start_vec.size();
         //        mqi::roi_t roi(method, original_size, length, start, stride);
         mqi::roi_t* roi = new mqi::roi_t(method, original_size, length, start, stride, acc_stride);
+        roi->build_bitmap();
         return roi;
     }
 };
@@ -1,6 +1,7 @@
 #ifndef MQI_FIPPEL_PHYSICS_HPP
 #define MQI_FIPPEL_PHYSICS_HPP
 
+#include <moqui/base/mqi_cross_section_table.hpp>
 #include <moqui/base/mqi_error_check.hpp>
 #include <moqui/base/mqi_p_ionization.hpp>
 #include <moqui/base/mqi_physics_list.hpp>
@@ -25,6 +26,8 @@ public:
     mqi::po_elastic_tabulated<R>   po_e;
     mqi::po_inelastic_tabulated<R> po_i;
 
+    const mqi::cross_section_table* cs_table;   ///< the four processes above, interleaved
+
     CUDA_HOST_DEVICE
     fippel_physics() :
         p_ion(0.1,
@@ -34,7 +37,7 @@ public:
               mqi::restricted_stopping_power_table,
               mqi::range_steps),
         pp_e(0.5, 300.0, 0.5, mqi::cs_pp_e_g4_table), po_e(0.5, 300.0, 0.5, mqi::cs_po_e_g4_table),
-        po_i(0.5, 300.0, 0.5, mqi::cs_po_i_g4_table)
+        po_i(0.5, 300.0, 0.5, mqi::cs_po_i_g4_table), cs_table(mqi::cross_sections_table())
 
     {
         ;
@@ -51,7 +54,7 @@ public:
                                               mqi::range_steps),
 
         pp_e(0.5, 300.0, 0.5, mqi::cs_pp_e_g4_table), po_e(0.5, 300.0, 0.5, mqi::cs_po_e_g4_table),
-        po_i(0.5, 300.0, 0.5, mqi::cs_po_i_g4_table)
+        po_i(0.5, 300.0, 0.5, mqi::cs_po_i_g4_table), cs_table(mqi::cross_sections_table())
 
     {
         ;
@@ -63,6 +66,16 @@ public:
         ;
     }
 
+    ///< Cross-sections of p_ion, pp_e, po_e and po_i (in this order) at Ek in mat
+    CUDA_HOST_DEVICE
+    inline void
+    cross_sections(const R Ek, const material_t<R>& mat, R* cs) const {
+        float cs_f[mqi::cross_section_table::n_processes];
+        cs_table->cross_sections(Ek, mat.rho_mass, cs_f);
+        for (uint16_t p = 0; p < mqi::cross_section_table::n_processes; ++p)
+            cs[p] = cs_f[p];
+    }
+
     ///< step length
     CUDA_HOST_DEVICE
     virtual void
@@ -84,27 +97,22 @@ public:
             return;
         }
 
-        mqi::relativistic_quantities<R> rel(trk.vtx0.ke, units.Mp);
-        R                               length = 0.0;
+        ///< pre-step quantities shared with along_step
+        const mqi::step_context_t<R>           ctx = p_ion.context(trk.vtx0.ke, mat);
+        const mqi::relativistic_quantities<R>& rel = ctx.rel;
         ///calculate maximum possible energy-loss
-        R max_loss_step    = max_energy_loss * -1.0 * rel.Ek / p_ion.dEdx(rel, mat);
+        R max_loss_step    = max_energy_loss * -1.0 * rel.Ek / ctx.dEdx;
         R current_min_step = this->max_step;
-        current_min_step   = current_min_step * mat.stopping_power_ratio(rel.Ek) * mat.rho_mass / this->units.water_density;
-        //current_min_step   = current_min_step * 1 * mat.rho_mass / this->units.water_density;
+        current_min_step   = current_min_step * ctx.water_equivalent;
         current_min_step  = (current_min_step <= max_loss_step) ? current_min_step : max_loss_step;
-        R max_loss_energy = -1.0 * current_min_step * p_ion.dEdx(rel, mat);
-        R cs1[4]          = { p_ion.cross_section(rel, mat),
-                     pp_e.cross_section(rel, mat),
-                     po_e.cross_section(rel, mat),
-                     po_i.cross_section(rel, mat) };
-        R cs1_sum         = cs1[0] + cs1[1] + cs1[2] + cs1[3];
-
-        mqi::relativistic_quantities<R> rel_de(trk.vtx0.ke - max_loss_energy, units.Mp);
-        R                               cs2[4]  = { p_ion.cross_section(rel_de, mat),
-                     pp_e.cross_section(rel_de, mat),
-                     po_e.cross_section(rel_de, mat),
-                     po_i.cross_section(rel_de, mat) };
-        R                               cs2_sum = cs2[0] + cs2[1] + cs2[2] + cs2[3];
+        R max_loss_energy = -1.0 * current_min_step * ctx.dEdx;
+        R cs1[4];
+        cross_sections(rel.Ek, mat, cs1);
+        R cs1_sum = cs1[0] + cs1[1] + cs1[2] + cs1[3];
+
+        R cs2[4];
+        cross_sections(trk.vtx0.ke - max_loss_energy, mat, cs2);
+        R cs2_sum = cs2[0] + cs2[1] + cs2[2] + cs2[3];
 
         ///< Pick bigger cross-section
         R  cs_sum = (cs1_sum >= cs2_sum) ? cs1_sum : cs2_sum;
@@ -112,8 +120,7 @@ public:
 
         R prob       = mqi_uniform<R>(rng);           //0-1
         R mfp        = -1.0f * logf(prob) / cs_sum;   // mm, rho_mass is g/mm^3
-        R step_limit = current_min_step * this->units.water_density / (mat.stopping_power_ratio(rel.Ek) * mat.rho_mass);
-        //R step_limit = current_min_step * this->units.water_density / (1 * mat.rho_mass);
+        R step_limit = current_min_step / ctx.water_equivalent;
 
 #ifdef DEBUG
 
@@ -133,7 +140,7 @@ public:
 
             assert(!mqi::mqi_isnan(trk.vtx0.ke) && !mqi::mqi_isnan(trk.vtx1.ke));
 
-            p_ion.along_step(trk, stk, rng, distance_to_boundary, mat);
+            p_ion.along_step(trk, stk, rng, distance_to_boundary, mat, ctx);
 
             assert_track<R>(trk, 0);
         } else if ((mfp < distance_to_boundary ||
@@ -147,7 +154,7 @@ public:
 #endif
 
             assert(!mqi::mqi_isnan(trk.vtx0.ke) && !mqi::mqi_isnan(trk.vtx1.ke));
-            p_ion.along_step(trk, stk, rng, mfp, mat);
+            p_ion.along_step(trk, stk, rng, mfp, mat, ctx);
             assert_track<R>(trk, 10);
             if (trk.vtx1.ke < this->Tp_cut) { return; }
             R u          = cs_sum * mqi_uniform<R>(rng);   //0-1
@@ -182,7 +189,7 @@ public:
             }
 #endif
             assert(!mqi::mqi_isnan(trk.vtx0.ke) && !mqi::mqi_isnan(trk.vtx1.ke));
-            p_ion.along_step(trk, stk, rng, step_limit, mat);
+            p_ion.along_step(trk, stk, rng, step_limit, mat, ctx);
             assert_track<R>(trk, 5);
         }
 
@@ -192,6 +199,85 @@ public:
         //don't trk.move() here
         return;
     }
+
+    ///< Woodcock (delta) tracking, step length.
+    ///< Samples the flight distance with the cross-sections and step limits of the
+    ///< majorant material, the densest one of the region, so the step may cross
+    ///< many voxels. cs_max receives the majorant cross-sections and interaction
+    ///< tells whether the step ends at a (real or virtual) interaction point.
+    CUDA_HOST_DEVICE
+    R
+    woodcock_length(track_t<R>&    trk,
+                    mqi_rng*       rng,
+                    material_t<R>& mat_max,
+                    const R&       distance_to_boundary,
+                    R*             cs_max,
+                    bool&          interaction) {
+        const mqi::step_context_t<R> ctx              = p_ion.context(trk.vtx0.ke, mat_max);
+        R                            max_loss_step    = max_energy_loss * -1.0 * ctx.rel.Ek / ctx.dEdx;
+        R                            current_min_step = this->max_step * ctx.water_equivalent;
+        current_min_step  = (current_min_step <= max_loss_step) ? current_min_step : max_loss_step;
+        R max_loss_energy = -1.0 * current_min_step * ctx.dEdx;
+
+        R cs1[4], cs2[4];
+        cross_sections(ctx.rel.Ek, mat_max, cs1);
+        cross_sections(trk.vtx0.ke - max_loss_energy, mat_max, cs2);
+        const R cs1_sum = cs1[0] + cs1[1] + cs1[2] + cs1[3];
+        const R cs2_sum = cs2[0] + cs2[1] + cs2[2] + cs2[3];
+        const R* cs     = (cs1_sum >= cs2_sum) ? cs1 : cs2;
+        for (int i = 0; i < 4; ++i)
+            cs_max[i] = cs[i];
+
+        const R mfp = -1.0f * logf(mqi_uniform<R>(rng)) / ((cs1_sum >= cs2_sum) ? cs1_sum : cs2_sum);
+        const R step_limit = current_min_step / ctx.water_equivalent;
+        R length    = (step_limit < distance_to_boundary) ? step_limit : distance_to_boundary;
+        interaction = mfp < length;
+        return interaction ? mfp : length;
+    }
+
+    ///< Woodcock (delta) tracking, transport over a step of the given length.
+    ///< The continuous loss and scattering use the water-equivalent length of the
+    ///< voxels crossed. At an interaction point the process is sampled against the
+    ///< majorant cross-sections: a real interaction in mat with probability
+    ///< cs(mat)/cs_max, a virtual one (nothing happens) otherwise.
+    ///< Returns the water-equivalent length actually travelled.
+    CUDA_HOST_DEVICE
+    R
+    woodcock_stepping(track_t<R>&       trk,
+                      track_stack_t<R>& stk,
+                      mqi_rng*          rng,
+                      const R&          length,
+                      const R&          length_in_water,
+                      bool              interaction,
+                      const R*          cs_max,
+                      material_t<R>&    mat,
+                      bool              score_local_deposit) {
+        mqi::h2o_t<R> water;
+        p_ion.along_step(trk, stk, rng, length_in_water, water);
+        assert_track<R>(trk, 20);
+        ///< along_step moved the track by the water-equivalent length, scale it back
+        const R moved = (trk.vtx1.pos - trk.vtx0.pos).norm();
+        trk.update_post_vertex_position((length_in_water > 0) ? moved * length / length_in_water
+                                                              : length);
+        if (!interaction || trk.is_stopped() || trk.vtx1.ke < this->Tp_cut) return moved;
+
+        R cs[4];
+        cross_sections(trk.vtx0.ke, mat, cs);
+        R u = (cs_max[0] + cs_max[1] + cs_max[2] + cs_max[3]) * mqi_uniform<R>(rng);
+        if (u >= cs[0] + cs[1] + cs[2] + cs[3]) return moved;   ///< virtual interaction
+        trk.vtx1.dir = trk.vtx0.dir;
+        if (u < cs[0]) {
+            p_ion.post_step(trk, stk, rng, length, mat, score_local_deposit);
+        } else if (u < (cs[0] + cs[1])) {
+            pp_e.post_step(trk, stk, rng, length, mat, score_local_deposit);
+        } else if (u < (cs[0] + cs[1] + cs[2])) {
+            po_e.post_step(trk, stk, rng, length, mat, score_local_deposit);
+        } else {
+            po_i.post_step(trk, stk, rng, length, mat, score_local_deposit);
+        }
+        assert_track<R>(trk, 21);
+        return moved;
+    }
 };
 
 }   // namespace mqi
@@ -6,6 +6,8 @@
 /// Rectlinear grid geometry for MC transport
 ///
 
+#include <limits>
+
 #include <moqui/base/mqi_common.hpp>
 #include <moqui/base/mqi_coordinate_transform.hpp>
 #include <moqui/base/mqi_math.hpp>
@@ -20,11 +22,25 @@ namespace mqi
 template<typename R>
 struct intersect_t {
     R              dist;   //distance to the intersection plane (cell), invalid when dist < 0
-    cell_side      side;   //side of entering cell
     vec3<ijk_t>    cell;   //index of entering cell
+    cell_side      side;   //side of entering cell
     transport_type type;   // type of current node's geometry
 };
 
+///< Voxel traversal state of a ray (Amanatides-Woo), kept by the transport loop.
+///  Plane distances are measured from origin along dir and advanced only for the
+///  axis whose cell index changed, so a step costs subtractions instead of
+///  per-axis divisions. A new direction (e.g. multiple scattering) re-seeds it.
+template<typename R>
+struct dda_t {
+    bool        valid = false;
+    vec3<R>     origin;    //point where the ray was seeded
+    vec3<R>     dir;       //direction at seeding
+    vec3<R>     inv_dir;   //1/dir, 0 for axes the ray does not cross
+    vec3<R>     t_exit;    //distance from origin to the exit plane of cell per axis
+    vec3<ijk_t> cell;      //cell the plane distances refer to
+};
+
 /// \class grid3d
 /// \tparam T for grid values, e.g., dose, HU, vector
 /// \tparam R for grid coordinates, float, double, etc.
@@ -55,10 +71,28 @@ protected:
     mqi::vec3<R> n010_;   ///< normal vector of 2nd (Y) axis
     mqi::vec3<R> n001_;   ///< normal vector of 3rd (Z) axis
 
+    ///< 1/spacing of axes with uniform edges, 0 for non-uniform axes
+    mqi::vec3<R> inv_spacing_;
+
     ///< Data in this rectlinear
     ///< size: dim_.x*dim_.y*dim_.z
     T* data_ = nullptr;
 
+    ///< Super-voxels: blocks of block_size_^3 voxels, block_dim_ blocks per axis.
+    ///< homogeneous_[block] is 1 if the data in the block are uniform within the
+    ///< tolerance given to build_super_voxels. block_size_ == 0 disables them,
+    ///< super_voxels_on_ == false suspends them.
+    ijk_t            block_size_      = 0;
+    mqi::vec3<ijk_t> block_dim_;
+    uint8_t*         homogeneous_     = nullptr;
+    bool             super_voxels_on_ = true;
+
+    ///< Woodcock majorants: largest data value of each block of majorant_block_^3
+    ///< voxels, majorant_dim_ blocks per axis. majorant_block_ == 0 disables them.
+    ijk_t            majorant_block_ = 0;
+    mqi::vec3<ijk_t> majorant_dim_;
+    T*               majorants_ = nullptr;
+
     ///< Calculate C000/C111
     CUDA_HOST_DEVICE
     void
@@ -86,6 +120,66 @@ protected:
         n100_.normalize();
         n010_.normalize();
         n001_.normalize();
+
+        inv_spacing_.x = uniform_inv_spacing(xe_, dim_.x);
+        inv_spacing_.y = uniform_inv_spacing(ye_, dim_.y);
+        inv_spacing_.z = uniform_inv_spacing(ze_, dim_.z);
+    }
+
+    ///< 1/spacing if the n+1 edges are evenly spaced, 0 otherwise
+    CUDA_HOST_DEVICE
+    static R
+    uniform_inv_spacing(const R* e, ijk_t n) {
+        if (n <= 0) return 0;
+        const R d = (e[n] - e[0]) / n;
+        if (d <= 0) return 0;
+        for (ijk_t i = 1; i < n; ++i) {
+            if (mqi::mqi_abs(e[i] - (e[0] + i * d)) > 1e-3 * d) return 0;
+        }
+        return 1 / d;
+    }
+
+    ///< Voxel index along one axis for a point p moving in direction d.
+    ///< Gives the same result as scanning every edge: a point within
+    ///< geometry_tolerance of an edge is assigned to the voxel the direction
+    ///< points into (the lower one for d == 0, except at the first edge).
+    ///< Uniform axes start from floor((p - e[0]) / spacing), the others from a
+    ///< binary search; the guess is then checked against the stored edges.
+    CUDA_HOST_DEVICE
+    static ijk_t
+    index_axis(const R* e, ijk_t n, R inv_spacing, R p, R d) {
+        if (n <= 0) return -1;
+        ijk_t j;
+        if (inv_spacing > 0) {
+            const R u = (p - e[0]) * inv_spacing;
+            j         = (u > 0) ? ((u < n) ? static_cast<ijk_t>(u) : n - 1) : 0;
+        } else {
+            ijk_t lo = 0, hi = n;   ///< e[lo] <= p < e[hi] for p inside
+            while (hi - lo > 1) {
+                const ijk_t mid = (lo + hi) / 2;
+                if (p < e[mid]) {
+                    hi = mid;
+                } else {
+                    lo = mid;
+                }
+            }
+            j = lo;
+        }
+        while (j > 0 && p < e[j])
+            --j;
+        while (j < n - 1 && p >= e[j + 1])
+            ++j;
+
+        ijk_t k = -1;   ///< edge within tolerance, the lower one first
+        if (mqi::mqi_abs(e[j] - p) < mqi::geometry_tolerance) {
+            k = j;
+        } else if (mqi::mqi_abs(e[j + 1] - p) < mqi::geometry_tolerance) {
+            k = j + 1;
+        }
+        if (k == 0) return (d < 0) ? -1 : 0;
+        if (k > 0) return (d > 0) ? k : k - 1;
+        if (e[j] < p && p < e[j + 1]) return j;
+        return -1;
     }
 
 public:
@@ -429,6 +523,12 @@ public:
     void
     delete_data_if_used(void) {
         if (data_ != nullptr) delete[] data_;
+        if (homogeneous_ != nullptr) delete[] homogeneous_;
+        homogeneous_ = nullptr;
+        block_size_  = 0;
+        if (majorants_ != nullptr) delete[] majorants_;
+        majorants_      = nullptr;
+        majorant_block_ = 0;
     }
 
     /// Initializes data, currently values are sum of index square for testing
@@ -467,6 +567,133 @@ public:
         return data_;
     }
 
+    /// Returns the largest data value, e.g., the majorant density of the grid
+    CUDA_HOST
+    T
+    max_data() const {
+        const cnb_t n = cnb_t(dim_.x) * dim_.y * dim_.z;
+        T           m = data_[0];
+        for (cnb_t i = 1; i < n; ++i)
+            if (data_[i] > m) m = data_[i];
+        return m;
+    }
+
+    ///< Groups the voxels in blocks of block_size^3 and flags the blocks whose
+    ///< data differ by at most tolerance * (largest value in the block).
+    ///< block_size < 2 disables the super-voxels.
+    CUDA_HOST
+    void
+    build_super_voxels(ijk_t block_size, R tolerance) {
+        if (homogeneous_ != nullptr) delete[] homogeneous_;
+        homogeneous_ = nullptr;
+        block_size_  = 0;
+        if (block_size < 2 || data_ == nullptr) return;
+        block_size_  = block_size;
+        block_dim_.x = (dim_.x + block_size - 1) / block_size;
+        block_dim_.y = (dim_.y + block_size - 1) / block_size;
+        block_dim_.z = (dim_.z + block_size - 1) / block_size;
+        const cnb_t n_blocks = cnb_t(block_dim_.x) * block_dim_.y * block_dim_.z;
+        T*          lo       = new T[n_blocks];
+        T*          hi       = new T[n_blocks];
+        homogeneous_         = new uint8_t[n_blocks];
+        for (cnb_t b = 0; b < n_blocks; ++b)
+            homogeneous_[b] = 0;
+        for (ijk_t k = 0; k < dim_.z; ++k) {
+            for (ijk_t j = 0; j < dim_.y; ++j) {
+                for (ijk_t i = 0; i < dim_.x; ++i) {
+                    const cnb_t b = (cnb_t(k / block_size) * block_dim_.y + j / block_size) *
+                                      block_dim_.x +
+                                    i / block_size;
+                    const T v = data_[ijk2cnb(i, j, k)];
+                    if (!homogeneous_[b]) {
+                        lo[b]           = v;
+                        hi[b]           = v;
+                        homogeneous_[b] = 1;
+                    } else {
+                        if (v < lo[b]) lo[b] = v;
+                        if (v > hi[b]) hi[b] = v;
+                    }
+                }
+            }
+        }
+        for (cnb_t b = 0; b < n_blocks; ++b) {
+            const T scale   = (hi[b] > 0) ? hi[b] : -lo[b];
+            homogeneous_[b] = (hi[b] - lo[b] <= tolerance * scale) ? 1 : 0;
+        }
+        delete[] lo;
+        delete[] hi;
+    }
+
+    ///< Suspends (false) or resumes (true) the super-voxels without rebuilding them
+    CUDA_HOST
+    void
+    enable_super_voxels(bool on) {
+        super_voxels_on_ = on;
+    }
+
+    ///< Stores the largest data value of each block of block_size^3 voxels,
+    ///< the majorant density of the block for Woodcock tracking.
+    ///< block_size < 1 disables the majorants.
+    CUDA_HOST
+    void
+    build_majorants(ijk_t block_size) {
+        if (majorants_ != nullptr) delete[] majorants_;
+        majorants_      = nullptr;
+        majorant_block_ = 0;
+        if (block_size < 1 || data_ == nullptr) return;
+        majorant_block_ = block_size;
+        majorant_dim_.x = (dim_.x + block_size - 1) / block_size;
+        majorant_dim_.y = (dim_.y + block_size - 1) / block_size;
+        majorant_dim_.z = (dim_.z + block_size - 1) / block_size;
+        const cnb_t n_blocks = cnb_t(majorant_dim_.x) * majorant_dim_.y * majorant_dim_.z;
+        majorants_           = new T[n_blocks];
+        for (cnb_t b = 0; b < n_blocks; ++b)
+            majorants_[b] = std::numeric_limits<T>::lowest();
+        for (ijk_t k = 0; k < dim_.z; ++k) {
+            for (ijk_t j = 0; j < dim_.y; ++j) {
+                for (ijk_t i = 0; i < dim_.x; ++i) {
+                    const cnb_t b = (cnb_t(k / block_size) * majorant_dim_.y + j / block_size) *
+                                      majorant_dim_.x +
+                                    i / block_size;
+                    const T v = data_[ijk2cnb(i, j, k)];
+                    if (v > majorants_[b]) majorants_[b] = v;
+                }
+            }
+        }
+    }
+
+    ///< Majorant density of the block of cell idx, or -1 if majorants are disabled
+    CUDA_HOST_DEVICE
+    R
+    majorant(const mqi::vec3<ijk_t>& idx) const {
+        if (majorant_block_ == 0) return -1;
+        const cnb_t b =
+          (cnb_t(idx.z / majorant_block_) * majorant_dim_.y + idx.y / majorant_block_) *
+            majorant_dim_.x +
+          idx.x / majorant_block_;
+        return majorants_[b];
+    }
+
+    ///< Number of majorant blocks (0 if they are disabled)
+    CUDA_HOST
+    cnb_t
+    n_majorant_blocks() const {
+        if (majorant_block_ == 0) return 0;
+        return cnb_t(majorant_dim_.x) * majorant_dim_.y * majorant_dim_.z;
+    }
+
+    ///< Number of homogeneous super-voxels (0 if they are disabled)
+    CUDA_HOST
+    cnb_t
+    n_homogeneous_blocks() const {
+        if (block_size_ == 0) return 0;
+        cnb_t       n        = 0;
+        const cnb_t n_blocks = cnb_t(block_dim_.x) * block_dim_.y * block_dim_.z;
+        for (cnb_t b = 0; b < n_blocks; ++b)
+            n += homogeneous_[b];
+        return n;
+    }
+
     CUDA_HOST_DEVICE
     R
     get_volume(const mqi::cnb_t p) {
@@ -625,6 +852,172 @@ public:
         return its;
     }
 
+    ///< intersect. a ray from a voxel (ijk) in the grid using the traversal state.
+    ///< Same distances and tolerance handling as intersect(p, d, idx), but the
+    ///< plane distances are only recomputed when the ray changes direction or
+    ///< leaves a cell along an axis.
+    CUDA_HOST_DEVICE
+    intersect_t<R>
+    intersect(mqi::vec3<R>& p, mqi::vec3<R>& d, mqi::vec3<ijk_t>& idx, dda_t<R>& dda) {
+        if (!dda.valid || d.x != dda.dir.x || d.y != dda.dir.y || d.z != dda.dir.z) {
+            ///< seed: zero the axes the ray does not cross, as intersect() does
+            if (d.x * d.x <= mqi::near_zero) d.x = 0;
+            if (d.y * d.y <= mqi::near_zero) d.y = 0;
+            if (d.z * d.z <= mqi::near_zero) d.z = 0;
+            dda.valid     = true;
+            dda.origin    = p;
+            dda.dir       = d;
+            dda.inv_dir.x = (d.x != 0) ? 1 / d.x : 0;
+            dda.inv_dir.y = (d.y != 0) ? 1 / d.y : 0;
+            dda.inv_dir.z = (d.z != 0) ? 1 / d.z : 0;
+            dda.cell      = idx;
+            dda.t_exit.x  = exit_distance(xe_, idx.x, p.x, d.x, dda.inv_dir.x);
+            dda.t_exit.y  = exit_distance(ye_, idx.y, p.y, d.y, dda.inv_dir.y);
+            dda.t_exit.z  = exit_distance(ze_, idx.z, p.z, d.z, dda.inv_dir.z);
+        } else {
+            ///< advance the planes of the axes whose cell changed
+            if (idx.x != dda.cell.x)
+                dda.t_exit.x = exit_distance(xe_, idx.x, dda.origin.x, d.x, dda.inv_dir.x);
+            if (idx.y != dda.cell.y)
+                dda.t_exit.y = exit_distance(ye_, idx.y, dda.origin.y, d.y, dda.inv_dir.y);
+            if (idx.z != dda.cell.z)
+                dda.t_exit.z = exit_distance(ze_, idx.z, dda.origin.z, d.z, dda.inv_dir.z);
+            dda.cell = idx;
+        }
+        ///< distance already travelled along the ray
+        const R t = (p - dda.origin).dot(d);
+
+        const R u_x = remaining_distance(dda.t_exit.x - t, d.x, idx.x, dim_.x);
+        const R u_y = remaining_distance(dda.t_exit.y - t, d.y, idx.y, dim_.y);
+        const R u_z = remaining_distance(dda.t_exit.z - t, d.z, idx.z, dim_.z);
+        R       u_max;
+        if (u_x < u_y) {
+            u_max = (u_x < u_z) ? u_x : u_z;
+        } else {
+            u_max = (u_y < u_z) ? u_y : u_z;
+        }
+
+        mqi::intersect_t<R> its;
+        its.side = mqi::NONE_XYZ_PLANE;
+        if (u_max > 0) {
+            its.dist = u_max;
+            its.cell = idx;
+        } else {
+            its.dist   = -1.0;
+            its.cell.x = -1;
+            its.cell.y = -1;
+            its.cell.z = -1;
+        }
+        return its;
+    }
+
+    ///< Distance from p inside the grid along d to the bounding box
+    CUDA_HOST_DEVICE
+    R
+    distance_to_exit(const mqi::vec3<R>& p, const mqi::vec3<R>& d) const {
+        R t = mqi::p_inf;
+        R u;
+        if (d.x != 0) {
+            u = ((d.x > 0) ? V111_.x - p.x : V000_.x - p.x) / d.x;
+            if (u < t) t = u;
+        }
+        if (d.y != 0) {
+            u = ((d.y > 0) ? V111_.y - p.y : V000_.y - p.y) / d.y;
+            if (u < t) t = u;
+        }
+        if (d.z != 0) {
+            u = ((d.z > 0) ? V111_.z - p.z : V000_.z - p.z) / d.z;
+            if (u < t) t = u;
+        }
+        return (t > 0) ? t : 0;
+    }
+
+    ///< Distance from p in cell idx along d to the faces of its super-voxel,
+    ///< or -1 if super-voxels are disabled or the block is not homogeneous
+    CUDA_HOST_DEVICE
+    R
+    super_voxel_distance(const mqi::vec3<R>&     p,
+                         const mqi::vec3<R>&     d,
+                         const mqi::vec3<ijk_t>& idx) const {
+        if (block_size_ == 0 || !super_voxels_on_) return -1;
+        const ijk_t bx = idx.x / block_size_;
+        const ijk_t by = idx.y / block_size_;
+        const ijk_t bz = idx.z / block_size_;
+        if (!homogeneous_[(cnb_t(bz) * block_dim_.y + by) * block_dim_.x + bx]) return -1;
+        R t = mqi::p_inf;
+        R u;
+        if (d.x != 0) {
+            u = block_face(xe_, dim_.x, bx, block_size_, p.x, d.x);
+            if (u < t) t = u;
+        }
+        if (d.y != 0) {
+            u = block_face(ye_, dim_.y, by, block_size_, p.y, d.y);
+            if (u < t) t = u;
+        }
+        if (d.z != 0) {
+            u = block_face(ze_, dim_.z, bz, block_size_, p.z, d.z);
+            if (u < t) t = u;
+        }
+        return (t > mqi::geometry_tolerance) ? t : -1;
+    }
+
+    ///< Distance from p in cell idx along d to the faces of its majorant block,
+    ///< or -1 if majorants are disabled
+    CUDA_HOST_DEVICE
+    R
+    majorant_distance(const mqi::vec3<R>&     p,
+                      const mqi::vec3<R>&     d,
+                      const mqi::vec3<ijk_t>& idx) const {
+        if (majorant_block_ == 0) return -1;
+        R t = mqi::p_inf;
+        R u;
+        if (d.x != 0) {
+            u = block_face(xe_, dim_.x, idx.x / majorant_block_, majorant_block_, p.x, d.x);
+            if (u < t) t = u;
+        }
+        if (d.y != 0) {
+            u = block_face(ye_, dim_.y, idx.y / majorant_block_, majorant_block_, p.y, d.y);
+            if (u < t) t = u;
+        }
+        if (d.z != 0) {
+            u = block_face(ze_, dim_.z, idx.z / majorant_block_, majorant_block_, p.z, d.z);
+            if (u < t) t = u;
+        }
+        return (t > 0) ? t : 0;
+    }
+
+    ///< Distance along one axis to the face of block b (of size voxels) the
+    ///< direction points to
+    CUDA_HOST_DEVICE
+    R
+    block_face(const R* e, ijk_t n, ijk_t b, ijk_t size, R p, R d) const {
+        if (d > 0) {
+            const ijk_t upper = (b + 1) * size;
+            return (e[(upper < n) ? upper : n] - p) / d;
+        }
+        return (e[b * size] - p) / d;
+    }
+
+    ///< Distance from o along d (inv_d = 1/d) to the exit plane of cell i on one axis
+    CUDA_HOST_DEVICE
+    static R
+    exit_distance(const R* e, ijk_t i, R o, R d, R inv_d) {
+        if (d == 0) return mqi::p_inf;
+        return ((d > 0) ? e[i + 1] - o : e[i] - o) * inv_d;
+    }
+
+    ///< Remaining distance to the exit plane; a plane closer than the tolerance
+    ///< is skipped like in intersect(p, d, idx)
+    CUDA_HOST_DEVICE
+    static R
+    remaining_distance(R u, R d, ijk_t i, ijk_t n) {
+        if (d == 0) return mqi::p_inf;
+        if (mqi::mqi_abs(u) < mqi::geometry_tolerance && ((d < 0) ? i > 0 : i < n)) {
+            return 1 / mqi::geometry_tolerance;
+        }
+        return u;
+    }
+
     ///< intersect. a ray from outside to entering the grid
     ///< return distance and side
     /// Calculated distance become integer and distance smaller than 1 is ignored
@@ -747,99 +1140,9 @@ public:
     index(const mqi::vec3<R>& p, mqi::vec3<R>& dir)   // if p is on boundary
     {   //find index for the first intersection, return voxel index
         mqi::vec3<ijk_t> idx;
-        R                min_x = 100.0, min_y = 100.0, min_z = 100.0;
-        for (int ind = 0; ind < dim_.x; ind++) {
-            if (mqi::mqi_abs(xe_[ind] - p.x) < mqi::geometry_tolerance) {
-                if (dir.x > 0) {
-                    idx.x = ind;
-                    break;
-                } else if (dir.x < 0) {
-                    idx.x = ind - 1;
-                    break;
-                } else {
-                    idx.x = ind;
-                    break;
-                }
-            } else if (mqi::mqi_abs(xe_[ind + 1] - p.x) < mqi::geometry_tolerance) {
-                if (dir.x > 0) {
-                    idx.x = ind + 1;
-                    break;
-                } else if (dir.x < 0) {
-                    idx.x = ind;
-                    break;
-                } else {
-                    idx.x = ind;
-                    break;
-                }
-            } else if (xe_[ind] - p.x < 0 && xe_[ind + 1] - p.x > 0) {
-                idx.x = ind;
-                break;
-            } else {
-                idx.x = -1;
-            }
-        }
-
-        for (int ind = 0; ind < dim_.y; ind++) {
-            if (mqi::mqi_abs(ye_[ind] - p.y) < mqi::geometry_tolerance) {
-                if (dir.y > 0) {
-                    idx.y = ind;
-                    break;
-                } else if (dir.y < 0) {
-                    idx.y = ind - 1;
-                    break;
-                } else {
-                    idx.y = ind;
-                    break;
-                }
-            } else if (mqi::mqi_abs(ye_[ind + 1] - p.y) < mqi::geometry_tolerance) {
-                if (dir.y > 0) {
-                    idx.y = ind + 1;
-                    break;
-                } else if (dir.y < 0) {
-                    idx.y = ind;
-                    break;
-                } else {
-                    idx.y = ind;
-                    break;
-                }
-            } else if (ye_[ind] - p.y < 0 && ye_[ind + 1] - p.y > 0) {
-                idx.y = ind;
-                break;
-            } else {
-                idx.y = -1;
-            }
-        }
-
-        for (int ind = 0; ind < dim_.z; ind++) {
-            if (mqi::mqi_abs(ze_[ind] - p.z) < mqi::geometry_tolerance) {
-                if (dir.z > 0) {
-                    idx.z = ind;
-                    break;
-                } else if (dir.z < 0) {
-                    idx.z = ind - 1;
-                    break;
-                } else {
-                    idx.z = ind;
-                    break;
-                }
-            } else if (mqi::mqi_abs(ze_[ind + 1] - p.z) < mqi::geometry_tolerance) {
-                if (dir.z > 0) {
-                    idx.z = ind + 1;
-                    break;
-                } else if (dir.z < 0) {
-                    idx.z = ind;
-                    break;
-                } else {
-                    idx.z = ind;
-                    break;
-                }
-            } else if (ze_[ind] - p.z < 0 && ze_[ind + 1] - p.z > 0) {
-                idx.z = ind;
-                break;
-            } else {
-                idx.z = -1;
-            }
-        }
+        idx.x = index_axis(xe_, dim_.x, inv_spacing_.x, p.x, dir.x);
+        idx.y = index_axis(ye_, dim_.y, inv_spacing_.y, p.y, dir.y);
+        idx.z = index_axis(ze_, dim_.z, inv_spacing_.z, p.z, dir.z);
         return idx;
     }
 
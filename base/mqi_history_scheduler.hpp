@@ -0,0 +1,246 @@
+#ifndef MQI_HISTORY_SCHEDULER_HPP
+#define MQI_HISTORY_SCHEDULER_HPP
+
+/// \file
+///
+/// Work-stealing scheduler of primary histories for the CPU transport backend.
+///
+/// Histories of a batch are first split evenly (start_and_length) and each
+/// split is placed in the deque of its thread. A thread takes chunks from the
+/// front of its own deque; the chunk size shrinks with the work left in the
+/// deque (large chunks first, min_chunk at the end). A thread with an empty
+/// deque steals the back half of the range of the most loaded thread, so cores
+/// that finish cheap histories (e.g. protons stopping in lung) take over the
+/// tail of expensive ones.
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include <moqui/base/mqi_thread_pool.hpp>
+#include <moqui/base/mqi_vec.hpp>
+#include <moqui/base/mqi_utils.hpp>
+
+namespace mqi
+{
+
+///< Per-thread balance report of a scheduled batch
+struct scheduler_stats_t {
+    uint32_t histories = 0;     ///< histories transported by this thread
+    uint32_t chunks    = 0;     ///< chunks executed (own and stolen)
+    uint32_t steals    = 0;     ///< successful steals from other threads
+    double   busy_ms   = 0.0;   ///< time spent in transport
+    double   idle_ms   = 0.0;   ///< time spent looking for work or waiting for the batch end
+};
+
+/// \class history_scheduler
+///
+/// Dispatches [begin, end) history chunks to the threads of a thread_pool.
+class history_scheduler
+{
+public:
+    ///< job signature: (thread_id, history begin, history end)
+    typedef std::function<void(uint32_t, uint32_t, uint32_t)> job_t;
+
+    CUDA_HOST
+    explicit history_scheduler(uint32_t n_threads, uint32_t min_chunk = 16) :
+        queues_(n_threads > 0 ? n_threads : 1), stats_(queues_.size()),
+        min_chunk_(min_chunk > 0 ? min_chunk : 1) {
+        ;
+    }
+
+    ///< Number of threads the scheduler dispatches to
+    CUDA_HOST
+    uint32_t
+    size() const {
+        return queues_.size();
+    }
+
+    ///< Fill the deques with an even split of n_histories and clear statistics
+    CUDA_HOST
+    void
+    reset(uint32_t n_histories) {
+        const uint32_t n_threads = this->size();
+        for (uint32_t t = 0; t < n_threads; ++t) {
+            const mqi::vec2<uint32_t> h_range = mqi::start_and_length(n_threads, n_histories, t);
+            history_queue_t&          q       = queues_[t];
+            std::lock_guard<std::mutex> lock(q.mtx);
+            q.ranges.clear();
+            if (h_range.y > 0) q.ranges.push_back(range_t{ h_range.x, h_range.x + h_range.y });
+            q.remaining = h_range.y;
+            stats_[t]   = scheduler_stats_t();
+        }
+    }
+
+    ///< Next chunk for a thread: own deque first, then steal.
+    ///< Returns false when no work is left anywhere.
+    CUDA_HOST
+    bool
+    next_chunk(uint32_t thread_id, uint32_t& begin, uint32_t& end) {
+        if (this->pop_front(thread_id, begin, end)) return true;
+        while (this->steal(thread_id)) {
+            stats_[thread_id].steals += 1;
+            if (this->pop_front(thread_id, begin, end)) return true;
+        }
+        return false;
+    }
+
+    ///< Run a batch of n_histories on the pool and collect per-thread statistics
+    CUDA_HOST
+    void
+    run(mqi::thread_pool& pool, uint32_t n_histories, const job_t& job) {
+        typedef std::chrono::steady_clock clock_t;
+        this->reset(n_histories);
+        std::vector<clock_t::time_point> finished(this->size());
+
+        pool.run(
+          [&](uint32_t thread_id, uint32_t) {
+              if (thread_id >= this->size()) return;
+              scheduler_stats_t& st = stats_[thread_id];
+              uint32_t           begin, end;
+              auto               t0 = clock_t::now();
+              while (true) {
+                  const bool found = this->next_chunk(thread_id, begin, end);
+                  auto       t1    = clock_t::now();
+                  st.idle_ms += std::chrono::duration<double, std::milli>(t1 - t0).count();
+                  if (!found) break;
+                  job(thread_id, begin, end);
+                  t0 = clock_t::now();
+                  st.busy_ms += std::chrono::duration<double, std::milli>(t0 - t1).count();
+                  st.histories += end - begin;
+                  st.chunks += 1;
+              }
+              finished[thread_id] = clock_t::now();
+          },
+          this->size());
+
+        ///< waiting for the slowest thread is idle time too
+        auto batch_end = clock_t::now();
+        for (uint32_t t = 0; t < this->size(); ++t) {
+            stats_[t].idle_ms +=
+              std::chrono::duration<double, std::milli>(batch_end - finished[t]).count();
+        }
+    }
+
+    ///< Statistics of the last batch
+    CUDA_HOST
+    const std::vector<scheduler_stats_t>&
+    stats() const {
+        return stats_;
+    }
+
+    ///< Print balance of the last batch. per_thread prints one line per thread.
+    CUDA_HOST
+    void
+    print_stats(bool per_thread = false) const {
+        uint32_t h_min = UINT32_MAX, h_max = 0, steals = 0;
+        double   busy = 0.0, idle = 0.0;
+        for (uint32_t t = 0; t < this->size(); ++t) {
+            const scheduler_stats_t& st = stats_[t];
+            if (per_thread) {
+                printf("Work-stealing scheduler.. : thread %3u histories %8u chunks %6u steals "
+                       "%4u busy %10.2f ms idle %10.2f ms\n",
+                       t,
+                       st.histories,
+                       st.chunks,
+                       st.steals,
+                       st.busy_ms,
+                       st.idle_ms);
+            }
+            h_min = (st.histories < h_min) ? st.histories : h_min;
+            h_max = (st.histories > h_max) ? st.histories : h_max;
+            steals += st.steals;
+            busy += st.busy_ms;
+            idle += st.idle_ms;
+        }
+        printf("Work-stealing scheduler.. : histories/thread min %u max %u, steals %u, idle "
+               "%.1f%%\n",
+               h_min,
+               h_max,
+               steals,
+               (busy + idle > 0.0) ? 100.0 * idle / (busy + idle) : 0.0);
+    }
+
+private:
+    struct range_t {
+        uint32_t begin;
+        uint32_t end;
+    };
+
+    ///< one deque per thread, on its own cache line
+    struct alignas(64) history_queue_t {
+        std::mutex            mtx;
+        std::deque<range_t>   ranges;
+        std::atomic<uint32_t> remaining{ 0 };
+    };
+
+    ///< Owner takes a chunk from the front of its deque.
+    ///< Chunk size is 1/8 of the work left, but not smaller than min_chunk_.
+    CUDA_HOST
+    bool
+    pop_front(uint32_t thread_id, uint32_t& begin, uint32_t& end) {
+        history_queue_t&            q = queues_[thread_id];
+        std::lock_guard<std::mutex> lock(q.mtx);
+        if (q.ranges.empty()) return false;
+        range_t& front = q.ranges.front();
+        uint32_t chunk = q.remaining.load(std::memory_order_relaxed) / 8;
+        if (chunk < min_chunk_) chunk = min_chunk_;
+        begin = front.begin;
+        end   = (front.end - front.begin > chunk) ? front.begin + chunk : front.end;
+        front.begin = end;
+        if (front.begin == front.end) q.ranges.pop_front();
+        q.remaining.fetch_sub(end - begin, std::memory_order_relaxed);
+        return true;
+    }
+
+    ///< Move the back half of the most loaded deque to the thief's deque
+    CUDA_HOST
+    bool
+    steal(uint32_t thief) {
+        while (true) {
+            uint32_t victim = thief, most = 0;
+            for (uint32_t t = 0; t < this->size(); ++t) {
+                if (t == thief) continue;
+                uint32_t r = queues_[t].remaining.load(std::memory_order_relaxed);
+                if (r > most) {
+                    most   = r;
+                    victim = t;
+                }
+            }
+            if (victim == thief) return false;
+
+            range_t loot;
+            {
+                history_queue_t&            q = queues_[victim];
+                std::lock_guard<std::mutex> lock(q.mtx);
+                if (q.ranges.empty()) continue;   // drained meanwhile, look again
+                range_t&       back = q.ranges.back();
+                const uint32_t n    = back.end - back.begin;
+                const uint32_t half = (n > min_chunk_) ? n / 2 : n;
+                loot.begin          = back.end - half;
+                loot.end            = back.end;
+                back.end            = loot.begin;
+                if (back.begin == back.end) q.ranges.pop_back();
+                q.remaining.fetch_sub(half, std::memory_order_relaxed);
+            }
+            history_queue_t&            mine = queues_[thief];
+            std::lock_guard<std::mutex> lock(mine.mtx);
+            mine.ranges.push_back(loot);
+            mine.remaining.fetch_add(loot.end - loot.begin, std::memory_order_relaxed);
+            return true;
+        }
+    }
+
+    std::vector<history_queue_t>   queues_;
+    std::vector<scheduler_stats_t> stats_;
+    const uint32_t                 min_chunk_;
+};
+
+}   // namespace mqi
+
+#endif
@@ -6,6 +6,10 @@
 /// A header including CUDA related headers and functions
 
 #include <moqui/base/mqi_common.hpp>
+#if !defined(__CUDACC__)
+#include <moqui/base/mqi_philox.hpp>
+#include <moqui/base/mqi_ziggurat.hpp>
+#endif
 
 #include <cmath>
 #include <mutex>
@@ -450,57 +454,50 @@ mqi_isnan(double s) {
     return std::isnan(s);
 }
 
-//compile: ERROR
-typedef std::default_random_engine mqi_rng;
-//typedef std::mt19937 mqi_rng;
+///< counter-based, one stream per history (see mqi_philox.hpp)
+typedef mqi::philox4x32 mqi_rng;
 
+///< [0, 1) from the upper 24 bits of one number
 template<>
 float
 mqi_uniform<float>(mqi_rng* rng) {
-    std::uniform_real_distribution<float> dist;
-    return dist(*rng);
+    return ((*rng)() >> 8) * 0x1.0p-24f;
 }
 
+///< [0, 1) from 53 bits of two numbers
 template<>
 double
 mqi_uniform<double>(mqi_rng* rng) {
-    std::uniform_real_distribution<double> dist;
-    return dist(*rng);
+    const uint64_t a = (*rng)() >> 5;
+    const uint64_t b = (*rng)() >> 6;
+    return (a * 67108864.0 + b) * 0x1.0p-53;
 }
 
+///< Ziggurat samplers on the thread's generator (see mqi_ziggurat.hpp)
 template<>
 float
 mqi_normal<float>(mqi_rng* rng, float avg, float sig) {
-    std::normal_distribution<float> dist(avg, sig);
-    return dist(*rng);
+    return mqi::ziggurat::host().normal(*rng) * sig + avg;
 }
 
 template<>
 double
 mqi_normal<double>(mqi_rng* rng, double avg, double sig) {
-    std::normal_distribution<double> dist(avg, sig);
-    return dist(*rng);
+    return mqi::ziggurat::host().normal(*rng) * sig + avg;
 }
 
 template<>
 float
 mqi_exponential<float>(mqi_rng* rng, float avg, float up) {
-    float                                x;
-    std::exponential_distribution<float> dist(avg);
-    x = dist(*rng);
-    //    do {
-    //        x = dist(*rng);
-    //    } while (x > up || x <= 0);
-    return x;
+    return mqi::ziggurat::host().exponential(*rng) / avg;
 }
 
 template<>
 double
 mqi_exponential<double>(mqi_rng* rng, double avg, double up) {
-    double                                x;
-    std::exponential_distribution<double> dist(avg);
+    double x;
     do {
-        x = dist(*rng);
+        x = mqi::ziggurat::host().exponential(*rng) / avg;
     } while (x > up || x <= 0);
     return x;
 }
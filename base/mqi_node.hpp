@@ -32,6 +32,10 @@ struct node_t {
     mqi::key_value** scorers_mean     = nullptr;
     mqi::key_value** scorers_variance = nullptr;
 
+    ///< Majorant density for Woodcock tracking in this node (CPU), used where the
+    ///< grid has no majorant blocks. 0: voxel-by-voxel transport
+    R majorant_density = 0;
+
     uint16_t           n_children = 0;
     struct node_t<R>** children   = nullptr;
 };
@@ -222,6 +222,85 @@ CUDA_CONSTANT const float range_steps[600] = {
 
 ///< delta_ionization
 ///< analytical model
+/// \class inverse_range_table
+/// Energy as a function of range: for a uniform grid of residual ranges, the
+/// last node of range_steps at or below each grid point. Finding the range_steps
+/// interval of a residual range then starts at most one grid cell away from it
+/// instead of scanning back from the pre-step energy.
+class inverse_range_table
+{
+public:
+    static constexpr uint16_t n_nodes = 600;    ///< size of range_steps
+    static constexpr uint16_t n_bins  = 4096;   ///< uniform range grid
+
+    float    inv_dr;           ///< 1 / grid spacing (mm^-1)
+    uint16_t first[n_bins];   ///< last node with range_steps[node] <= bin * dr
+
+    ///< Left node n of the range_steps interval holding r, at most n_max
+    ///< (0 below the first node), as the backward scan from n_max would give
+    template<typename R>
+    CUDA_HOST_DEVICE
+    inline uint16_t
+    node(const R* r_steps, R r, uint16_t n_max) const {
+        uint32_t bin = (r > 0) ? uint32_t(r * inv_dr) : 0;
+        if (bin >= n_bins) bin = n_bins - 1;
+        uint16_t n = first[bin];
+        while (n + 1 < n_nodes && r_steps[n + 1] <= r)
+            ++n;
+        return (n < n_max) ? n : n_max;
+    }
+
+    ///< Host copy, built once from range_steps
+    CUDA_HOST
+    static const inverse_range_table&
+    host() {
+        static const inverse_range_table table = [] {
+            inverse_range_table t;
+            const double        dr = double(range_steps[n_nodes - 1]) / n_bins;
+            t.inv_dr               = float(1.0 / dr);
+            uint16_t n             = 0;
+            for (uint16_t bin = 0; bin < n_bins; ++bin) {
+                while (n + 1 < n_nodes && range_steps[n + 1] <= bin * dr)
+                    ++n;
+                t.first[bin] = n;
+            }
+            return t;
+        }();
+        return table;
+    }
+};
+
+#if defined(__CUDACC__)
+///< Device copy of inverse_range_table::host()
+static __device__ inverse_range_table range_table_device;
+#endif
+
+///< Table for the side of the code calling it
+CUDA_HOST_DEVICE
+inline const inverse_range_table*
+inverse_range_steps() {
+#if defined(__CUDA_ARCH__)
+    return &range_table_device;
+#else
+    return &inverse_range_table::host();
+#endif
+}
+
+///< Pre-step quantities of a proton in a material, computed once per step and
+///< shared by fippel_physics::stepping, along_step and energy_loss
+template<typename R>
+struct step_context_t {
+    relativistic_quantities<R> rel;                ///< at the pre-step energy
+    R                          dEdx;               ///< restricted stopping power (negative)
+    R                          water_equivalent;   ///< spr * rho_mass / water_density
+    R                          radiation_length;   ///< of the material (mm)
+
+    CUDA_HOST_DEVICE
+    step_context_t(R ke, R mc2) : rel(ke, mc2) {
+        ;
+    }
+};
+
 template<typename R>
 class p_ionization_tabulated : public interaction<R, mqi::PROTON>
 {
@@ -238,10 +317,18 @@ class p_ionization_tabulated : public interaction<R, mqi::PROTON>
     ///< Energy and range table
     const R* r_steps;
 
+    ///< Inverse of r_steps, if it is range_steps
+    const inverse_range_table* r_inverse;
+
+    ///< radiation length of the last density (the same over homogeneous regions)
+    R last_density          = -1;
+    R last_radiation_length = 0;
+
 public:
     CUDA_HOST_DEVICE
     p_ionization_tabulated(R m, R M, R s, const R* p, const R* q, const R* r) :
-        Ei(m), Ef(M), E_step(s), cs_table(p), pw_table(q), r_steps(r) {}
+        Ei(m), Ef(M), E_step(s), cs_table(p), pw_table(q), r_steps(r),
+        r_inverse((r == mqi::range_steps) ? mqi::inverse_range_steps() : nullptr) {}
 
     CUDA_HOST_DEVICE
     ~p_ionization_tabulated() {
@@ -292,6 +379,22 @@ public:
         return Te_max * this->T_cut / ((1.0 - eta) * Te_max + eta * this->T_cut);
     }
 
+    ///< Pre-step quantities of a proton of energy ke in mat
+    CUDA_HOST_DEVICE
+    inline step_context_t<R>
+    context(const R ke, material_t<R>& mat) {
+        step_context_t<R> ctx(ke, this->units.Mp);
+        ctx.dEdx = this->dEdx(ctx.rel, mat);
+        ctx.water_equivalent =
+          mat.stopping_power_ratio(ke) * mat.rho_mass / this->units.water_density;
+        if (mat.rho_mass != last_density) {
+            last_density          = mat.rho_mass;
+            last_radiation_length = this->radiation_length(mat.rho_mass);
+        }
+        ctx.radiation_length = last_radiation_length;
+        return ctx;
+    }
+
     ///< Energy loss (positive)
     CUDA_HOST_DEVICE
     virtual inline R
@@ -299,9 +402,19 @@ public:
                 material_t<R>&                    mat,
                 const R                           step_length,
                 mqi_rng*                          rng) {
-        ///< n is left index of energy & range steps table
         R length_in_water = step_length * mat.stopping_power_ratio(rel.Ek) * mat.rho_mass / this->units.water_density;
         //R length_in_water = step_length * 1 * mat.rho_mass / this->units.water_density;
+        return energy_loss_in_water(rel, mat, length_in_water, rng);
+    }
+
+    ///< Energy loss (positive) over a water-equivalent length
+    CUDA_HOST_DEVICE
+    inline R
+    energy_loss_in_water(const relativistic_quantities<R>& rel,
+                         material_t<R>&                    mat,
+                         const R                           length_in_water,
+                         mqi_rng*                          rng) {
+        ///< n is left index of energy & range steps table
         uint16_t n  = uint16_t((rel.Ek - this->Ei) / this->E_step);
         R        x0 = this->Ei + n * this->E_step;
         R        x1 = x0 + this->E_step;
@@ -312,9 +425,13 @@ public:
         if (r < length_in_water) return rel.Ek;   //< maximum energy loss
         r -= length_in_water;                     //< update residual range
         ///< find new 'n' for new energy ranges for interpolation
-        do {
-            if (r >= r_steps[n]) break;
-        } while (--n > 0);
+        if (r_inverse) {
+            n = r_inverse->node(r_steps, r, n);
+        } else {
+            do {
+                if (r >= r_steps[n]) break;
+            } while (--n > 0);
+        }
         x0        = this->Ei + n * this->E_step;
         x1        = x0 + this->E_step;
         R dE_mean = rel.Ek - mqi::intpl1d(r, r_steps[n], r_steps[n + 1], x0, x1);
@@ -369,17 +486,28 @@ public:
                mqi_rng*          rng,
                const R           len,
                material_t<R>&    mat) {
-        mqi::relativistic_quantities<R> rel(trk.vtx0.ke, this->units.Mp);
+        this->along_step(trk, stk, rng, len, mat, this->context(trk.vtx0.ke, mat));
+    }
+
+    ///< CSDA with the pre-step quantities already computed by the caller
+    CUDA_HOST_DEVICE
+    void
+    along_step(track_t<R>&              trk,
+               track_stack_t<R>&        stk,
+               mqi_rng*                 rng,
+               const R                  len,
+               material_t<R>&           mat,
+               const step_context_t<R>& ctx) {
+        const mqi::relativistic_quantities<R>& rel = ctx.rel;
         ///< CSDA energy loss
 #ifdef DEBUG
-        printf("len %f rsp %f density %f water density %f length in water %f mm\n",
+        printf("len %f density %f water density %f length in water %f mm\n",
                len,
-               mat.stopping_power_ratio(rel.Ek),
                mat.rho_mass,
                this->units.water_density,
-               len * mat.stopping_power_ratio(rel.Ek) * mat.rho_mass / this->units.water_density);
+               len * ctx.water_equivalent);
 #endif
-        R dE = this->energy_loss(rel, mat, len, rng);
+        R dE = this->energy_loss_in_water(rel, mat, len * ctx.water_equivalent, rng);
         ///< Update track (KE & POS & DIR)
         R r = 1.0;
         if (dE >= trk.vtx0.ke) {
@@ -389,7 +517,7 @@ public:
         assert(dE * r >= 0);
         ///< Multiple Coulomb SCattering (MSC)
         R P                    = rel.momentum();
-        R radiation_length_mat = this->radiation_length(mat.rho_mass);
+        R radiation_length_mat = ctx.radiation_length;
 
         R th_sq = ((this->Es / P) * (this->Es / P) / rel.beta_sq) * len / radiation_length_mat;
         R th    = mqi::mqi_sqrt(th_sq);
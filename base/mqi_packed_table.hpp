@@ -0,0 +1,109 @@
+#ifndef MQI_PACKED_TABLE_HPP
+#define MQI_PACKED_TABLE_HPP
+
+/// \file
+///
+/// Scorer table with (voxel, spot) packed into one 64-bit key.
+///
+/// mqi::key_value claims key1 and key2 with two independent CAS operations,
+/// which can tear when two threads probe the same slot. Here a slot is claimed
+/// with a single compare-and-swap of the packed key. Keys and values are kept
+/// in separate arrays (SoA); eight keys form a 64-byte bucket so the first
+/// probes of a hashed key stay in one cache line. A key is expected within
+/// max_probe_ slots; longer probe sequences continue through the whole table
+/// and are counted in long_probes_. Only a deposit that finds every slot taken
+/// by other keys is lost; it is counted in overflow_ and fails the run.
+///
+/// Readers go through entry(), which returns the same key1/key2/value triple
+/// as mqi::key_value (see scorer::entry).
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#include <moqui/base/mqi_common.hpp>
+#include <moqui/base/mqi_hash_table.hpp>
+
+namespace mqi
+{
+
+/// \class packed_table
+class packed_table
+{
+public:
+    static constexpr uint64_t empty_key    = 0xffffffffffffffffULL;
+    static constexpr uint32_t bucket_slots = 8;   ///< 8 x 64-bit keys = one cache line
+
+    uint64_t*          keys_      = nullptr;   ///< packed (key1 << 32 | key2)
+    double*            values_    = nullptr;   ///< value of the key at the same slot
+    uint32_t           capacity_  = 0;         ///< number of slots, multiple of bucket_slots
+    uint32_t           max_probe_   = 0;   ///< expected longest probe sequence
+    unsigned long long long_probes_ = 0;   ///< deposits stored beyond max_probe_ slots
+    unsigned long long overflow_    = 0;   ///< deposits dropped, the table being full
+
+    ///< Allocate at least capacity slots; max_probe is the expected probe bound
+    CUDA_HOST
+    packed_table(uint32_t capacity, uint32_t max_probe = 64 * bucket_slots) {
+        capacity_  = ((capacity + bucket_slots - 1) / bucket_slots) * bucket_slots;
+        max_probe_ = (max_probe < capacity_) ? max_probe : capacity_;
+        keys_ = static_cast<uint64_t*>(std::aligned_alloc(64, sizeof(uint64_t) * capacity_));
+        values_ = static_cast<double*>(std::aligned_alloc(64, sizeof(double) * capacity_));
+        if (!keys_ || !values_) throw std::bad_alloc();
+        this->clear();
+    }
+
+    CUDA_HOST
+    ~packed_table() {
+        std::free(keys_);
+        std::free(values_);
+    }
+
+    packed_table(const packed_table&) = delete;
+    packed_table&
+    operator=(const packed_table&) = delete;
+
+    ///< Reset every slot to empty
+    CUDA_HOST
+    void
+    clear() {
+        std::memset(keys_, 0xff, sizeof(uint64_t) * capacity_);
+        std::memset(values_, 0, sizeof(double) * capacity_);
+        long_probes_ = 0;
+        overflow_    = 0;
+    }
+
+    CUDA_HOST_DEVICE
+    static uint64_t
+    pack(mqi::key_t key1, mqi::key_t key2) {
+        return (static_cast<uint64_t>(key1) << 32) | key2;
+    }
+
+    ///< First slot to probe.
+    ///< key2 == empty_pair keeps the direct voxel addressing of insert_hashtable,
+    ///< otherwise the key is hashed to the start of a bucket.
+    CUDA_HOST_DEVICE
+    uint32_t
+    home_slot(mqi::key_t key1, mqi::key_t key2) const {
+        if (key2 == mqi::empty_pair) return key1 % capacity_;
+        uint64_t h = pack(key1, key2) * 0x9e3779b97f4a7c15ULL;
+        h ^= h >> 29;
+        return static_cast<uint32_t>(h % (capacity_ / bucket_slots)) * bucket_slots;
+    }
+
+    ///< Entry at a slot in key_value form (key1/key2 = empty_pair if unused)
+    CUDA_HOST_DEVICE
+    mqi::key_value
+    entry(uint32_t slot) const {
+        mqi::key_value kv;
+        const uint64_t key = keys_[slot];
+        kv.key1            = static_cast<mqi::key_t>(key >> 32);
+        kv.key2            = static_cast<mqi::key_t>(key & 0xffffffff);
+        kv.value           = values_[slot];
+        return kv;
+    }
+};
+
+}   // namespace mqi
+
+#endif
@@ -0,0 +1,125 @@
+#ifndef MQI_PHILOX_HPP
+#define MQI_PHILOX_HPP
+
+/// \file
+///
+/// Counter-based random number generator (Philox4x32-10, Salmon et al., SC'11).
+///
+/// A block of four 32-bit numbers is a pure function of a 128-bit counter and a
+/// 64-bit key, so a random stream needs no state other than its position. The key
+/// holds (master seed, beam number) and the counter (block, spot, history): the
+/// numbers a history draws depend only on its identity, not on the thread or the
+/// batch it is transported in. This is the CPU mqi_rng; CUDA builds keep curand.
+
+#include <moqui/base/mqi_common.hpp>
+
+namespace mqi
+{
+
+/// \class philox4x32
+/// Satisfies UniformRandomBitGenerator, so std distributions accept it
+class philox4x32
+{
+public:
+    typedef uint32_t result_type;
+
+    static constexpr uint32_t M0 = 0xD2511F53;   ///< round multipliers
+    static constexpr uint32_t M1 = 0xCD9E8D57;
+    static constexpr uint32_t W0 = 0x9E3779B9;   ///< key schedule (Weyl sequence)
+    static constexpr uint32_t W1 = 0xBB67AE85;
+
+    ///< first block of the vertex streams; transport draws from block 0 up
+    static constexpr uint32_t VERTEX_BLOCK = 0x80000000;
+
+    ///< global history index of vertex 0 of the batch being transported
+    uint64_t history_offset = 0;
+
+    CUDA_HOST
+    philox4x32(uint32_t seed = 0, uint32_t beam = 0) {
+        this->seed(seed, beam);
+    }
+
+    CUDA_HOST
+    static constexpr result_type
+    min() {
+        return 0;
+    }
+
+    CUDA_HOST
+    static constexpr result_type
+    max() {
+        return 0xFFFFFFFF;
+    }
+
+    ///< Set the key and restart at stream (0, 0)
+    CUDA_HOST
+    void
+    seed(uint32_t seed, uint32_t beam = 0) {
+        key_[0] = seed;
+        key_[1] = beam;
+        stream(0, 0);
+    }
+
+    ///< Restart at the first number of the stream of a history
+    ///< \param block first block, VERTEX_BLOCK for the vertex of the history
+    CUDA_HOST
+    void
+    stream(uint32_t spot, uint64_t history, uint32_t block = 0) {
+        ctr_[0] = block;
+        ctr_[1] = spot;
+        ctr_[2] = uint32_t(history);
+        ctr_[3] = uint32_t(history >> 32);
+        n_used_ = 4;
+    }
+
+    CUDA_HOST
+    result_type
+    operator()() {
+        if (n_used_ == 4) {
+            block(ctr_, key_, out_);
+            ++ctr_[0];
+            n_used_ = 0;
+        }
+        return out_[n_used_++];
+    }
+
+    CUDA_HOST
+    void
+    discard(unsigned long long z) {
+        for (; z > 0; --z)
+            (*this)();
+    }
+
+    ///< Ten rounds on (ctr, key). Only multiplies, xors and adds, without branches,
+    ///< so a loop over counters vectorizes.
+    CUDA_HOST
+    static inline void
+    block(const uint32_t ctr[4], const uint32_t key[2], uint32_t out[4]) {
+        uint32_t c0 = ctr[0], c1 = ctr[1], c2 = ctr[2], c3 = ctr[3];
+        uint32_t k0 = key[0], k1 = key[1];
+        for (int r = 0; r < 10; ++r) {
+            const uint64_t p0 = uint64_t(M0) * c0;
+            const uint64_t p1 = uint64_t(M1) * c2;
+            c0                = uint32_t(p1 >> 32) ^ c1 ^ k0;
+            c1                = uint32_t(p1);
+            c2                = uint32_t(p0 >> 32) ^ c3 ^ k1;
+            c3                = uint32_t(p0);
+            k0 += W0;
+            k1 += W1;
+        }
+        out[0] = c0;
+        out[1] = c1;
+        out[2] = c2;
+        out[3] = c3;
+    }
+
+private:
+    uint32_t key_[2];
+    uint32_t ctr_[4];
+    uint32_t out_[4];
+    uint8_t  n_used_;   ///< numbers of out_ already returned
+};
+
+}   // namespace mqi
+
+#endif
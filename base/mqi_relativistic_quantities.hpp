@@ -46,7 +46,7 @@ public:
 
     CUDA_HOST_DEVICE
     R
-    momentum() {
+    momentum() const {
         return mqi::mqi_sqrt(Et * Et - mc2 * mc2);
     }
 };
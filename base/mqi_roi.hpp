@@ -31,6 +31,12 @@ public:
     uint32_t* stride_;       //< number of consecutive pixels
     uint32_t* acc_stride_;   //accumulated stride -> mapped to scorer idx
 
+    ///< CONTOUR membership, one bit per transport pixel, and the number of roi-pixels
+    ///< before each 32-bit word, i.e. the scorer idx of its first member.
+    ///< Set by build_bitmap; without them CONTOUR lookups search start_.
+    uint32_t* bitmap_ = nullptr;
+    uint32_t* rank_   = nullptr;
+
 public:
     CUDA_HOST_DEVICE
     roi_t(roi_mapping_t m,
@@ -84,9 +90,41 @@ public:
         }
     }
 
+    ///< Number of 32-bit words of bitmap_ and rank_
+    CUDA_HOST_DEVICE
+    uint32_t
+    n_bitmap_words() const {
+        return (original_length_ + 31) / 32;
+    }
+
+    ///< Build bitmap_ and rank_ from the start_, stride_ arrays (CONTOUR only)
+    CUDA_HOST
+    void
+    build_bitmap() {
+        if (method_ != CONTOUR || bitmap_ != nullptr) return;
+        const uint32_t n_words = this->n_bitmap_words();
+        bitmap_                = new uint32_t[n_words]();
+        rank_                  = new uint32_t[n_words];
+        for (uint32_t c = 0; c < length_; ++c) {
+            for (uint32_t v = start_[c]; v < start_[c] + stride_[c]; ++v)
+                bitmap_[v >> 5] |= 1u << (v & 31);
+        }
+        uint32_t members = 0;
+        for (uint32_t w = 0; w < n_words; ++w) {
+            rank_[w] = members;
+            members += popcount(bitmap_[w]);
+        }
+    }
+
     CUDA_HOST_DEVICE
     int32_t
     get_contour_idx(const uint32_t& v) const {
+        if (bitmap_ != nullptr) {
+            const uint32_t word = bitmap_[v >> 5];
+            const uint32_t bit  = 1u << (v & 31);
+            if (!(word & bit)) return -1;
+            return rank_[v >> 5] + popcount(word & (bit - 1));
+        }
         int32_t  c        = this->lower_bound_cpp(v) - 1;
         uint32_t distance = v - start_[c];
         if (distance < stride_[c]) {
@@ -100,6 +138,7 @@ public:
     CUDA_HOST_DEVICE
     int32_t
     idx_contour(const uint32_t& v) const {
+        if (bitmap_ != nullptr) return ((bitmap_[v >> 5] >> (v & 31)) & 1) ? 1 : -1;
         int32_t  c        = this->lower_bound_cpp(v) - 1;
         uint32_t distance = v - start_[c];
         if (distance < stride_[c]) {
@@ -138,6 +177,16 @@ public:
         }
         return first;
     }
+
+    CUDA_HOST_DEVICE
+    static inline uint32_t
+    popcount(uint32_t x) {
+#if defined(__CUDA_ARCH__)
+        return __popc(x);
+#else
+        return __builtin_popcount(x);
+#endif
+    }
 };
 
 }   // namespace mqi
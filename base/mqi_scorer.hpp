@@ -5,6 +5,7 @@
 
 #include <moqui/base/mqi_common.hpp>
 #include <moqui/base/mqi_hash_table.hpp>
+#include <moqui/base/mqi_packed_table.hpp>
 #include <moqui/base/mqi_roi.hpp>
 
 namespace mqi
@@ -19,6 +20,21 @@ typedef enum
     LETt              = 5,   //Track weighted LET
     TRACK_LENGTH      = 6    //Track length
 } scorer_t;
+
+///< Hit computation of a scorer known at compile time (see hit_policy).
+///< GENERIC_HIT calls the function pointer compute_hit_.
+typedef enum : uint8_t
+{
+    GENERIC_HIT          = 0,
+    ENERGY_DEPOSIT_HIT   = 1,   //energy_deposit
+    DOSE_TO_WATER_HIT    = 2,   //dose_to_water
+    DOSE_TO_MEDIUM_HIT   = 3,   //dose_to_medium
+    LETD_NUMERATOR_HIT   = 4,   //LETd_weight1
+    LETD_DENOMINATOR_HIT = 5,   //LETd_weight2
+    TRACK_LENGTH_HIT     = 6,   //LETt_weight2
+    DOSE_LETD_HIT        = 7    //dose_to_water, LETd_weight1 and LETd_weight2 in one pass
+} hit_t;
+
 ///< Foward declerations
 
 // track_t
@@ -44,11 +60,31 @@ public:
     ///< Function pointer for a callback function
     const fp_compute_hit<R> compute_hit_;
 
+    ///< Inlined hit computation used instead of compute_hit_ unless GENERIC_HIT
+    hit_t hit_ = GENERIC_HIT;
+
+    ///< Maximum number of quantities scored under one key
+    static constexpr uint8_t max_quantities = 3;
+
+    ///< Quantities per key: the table value and n_quantities_ - 1 companions
+    uint8_t n_quantities_ = 1;
+
+    ///< Companion q (>= 1) of table slot i at quantities_[(q - 1) * max_capacity_ + i],
+    ///< so one probe of the table serves all quantities (CPU, see allocate_quantities)
+    double* quantities_ = nullptr;
+
     ///< Memory area for scorer data
     mqi::key_value* data_             = nullptr;
     uint32_t        max_capacity_     = 0;   //// Max capacity is 32-bit integer
     uint32_t        current_capacity_ = 0;   //// Max capacity is 32-bit integer
 
+    ///< Optional 64-bit packed-key table used instead of data_ (CPU)
+    mqi::packed_table* packed_ = nullptr;
+
+    ///< Optional dense per-voxel array used instead of data_ (CPU, per-beam).
+    ///< dense_[voxel] holds the sum of the deposits, key2 is not stored.
+    double* dense_ = nullptr;
+
     scorer_t type_;   //< TODO: will be gone
 
     ///< Region of interest how to map transport pixel to scoring pixel
@@ -68,9 +104,13 @@ public:
 
     ///< Construct with size
     CUDA_HOST_DEVICE
-    scorer(const char* name, const uint32_t max_capacity, const fp_compute_hit<R> func_pointer) :
-        name_(name), max_capacity_(max_capacity), current_capacity_(max_capacity),
-        compute_hit_(func_pointer) {
+    scorer(const char*             name,
+           const uint32_t          max_capacity,
+           const fp_compute_hit<R> func_pointer,
+           const hit_t             hit = GENERIC_HIT) :
+        name_(name), compute_hit_(func_pointer), hit_(hit),
+        n_quantities_((hit == DOSE_LETD_HIT) ? 3 : 1), max_capacity_(max_capacity),
+        current_capacity_(max_capacity) {
         this->delete_data_if_used();
     }
 
@@ -86,6 +126,44 @@ public:
         if (count_ != nullptr) delete[] count_;
         if (mean_ != nullptr) delete[] mean_;
         if (variance_ != nullptr) delete[] variance_;
+#if !defined(__CUDACC__)
+        if (packed_ != nullptr) delete packed_;
+        if (dense_ != nullptr) delete[] dense_;
+        if (quantities_ != nullptr) delete[] quantities_;
+#endif
+    }
+
+    ///< Table entry at a slot, whichever table layout is in use.
+    ///< Readers iterate ind < max_capacity_ and use key1, key2, and value.
+    CUDA_HOST_DEVICE
+    mqi::key_value
+    entry(uint32_t ind) const {
+        if (dense_ != nullptr) {
+            mqi::key_value kv;
+            kv.key1  = (dense_[ind] > 0) ? ind : mqi::empty_pair;
+            kv.key2  = (dense_[ind] > 0) ? 0 : mqi::empty_pair;
+            kv.value = dense_[ind];
+            return kv;
+        }
+        if (packed_ != nullptr) return packed_->entry(ind);
+        return data_[ind];
+    }
+
+    ///< Quantity q of the entry at a slot; q = 0 is entry(ind).value
+    CUDA_HOST_DEVICE
+    double
+    quantity(uint32_t ind, uint8_t q) const {
+        if (q == 0) return this->entry(ind).value;
+        return quantities_[(q - 1) * size_t(max_capacity_) + ind];
+    }
+
+    ///< Storage of the companion quantities. Call once the table (and so
+    ///< max_capacity_) is set up.
+    CUDA_HOST
+    void
+    allocate_quantities() {
+        if (n_quantities_ < 2 || quantities_ != nullptr) return;
+        quantities_ = new double[(n_quantities_ - 1) * size_t(max_capacity_)]();
     }
     CUDA_DEVICE
     unsigned long long int
@@ -188,7 +266,13 @@ public:
     CUDA_HOST
     void
     clear_data() {
-        std::memset(data_, 0xff, sizeof(mqi::key_value) * this->max_capacity_);
+        if (dense_ != nullptr) std::memset(dense_, 0, sizeof(double) * this->max_capacity_);
+        if (packed_ != nullptr) packed_->clear();
+        if (quantities_ != nullptr) {
+            std::memset(
+              quantities_, 0, sizeof(double) * (n_quantities_ - 1) * size_t(this->max_capacity_));
+        }
+        if (data_ != nullptr) std::memset(data_, 0xff, sizeof(mqi::key_value) * this->max_capacity_);
         if (this->score_variance_) {
             std::memset(count_, 0xff, sizeof(mqi::key_value) * this->max_capacity_);
             std::memset(mean_, 0xff, sizeof(mqi::key_value) * this->max_capacity_);
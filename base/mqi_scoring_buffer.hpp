@@ -0,0 +1,175 @@
+#ifndef MQI_SCORING_BUFFER_HPP
+#define MQI_SCORING_BUFFER_HPP
+
+/// \file
+///
+/// Private (single writer) scoring buffer for the CPU backend.
+///
+/// Each history slice deposits into its own buffer without atomics or locks.
+/// At the end of a batch the buffers are merged into the shared scorer table
+/// in slice order (see mc::reduce_scoring_buffers), so a deposit sequence is
+/// always summed in the same order.
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include <moqui/base/mqi_common.hpp>
+
+namespace mqi
+{
+
+/// \class scoring_buffer
+///
+/// Growable open-addressing table of (key1, key2) -> value.
+/// key1 is the voxel (cnb) and key2 the spot offset, or mqi::empty_pair.
+/// A key can hold several quantities (n_values()), stored next to each other.
+/// Iteration order only depends on the sequence of add() calls.
+class scoring_buffer
+{
+public:
+    CUDA_HOST
+    explicit scoring_buffer(uint32_t initial_capacity = 1024) {
+        uint32_t capacity = 16;
+        while (capacity < initial_capacity)
+            capacity <<= 1;
+        keys_.assign(capacity, empty_key);
+        values_.assign(capacity, 0.0);
+    }
+
+    ///< Accumulate a deposit. Non-positive values are ignored like insert_hashtable.
+    CUDA_HOST
+    void
+    add(mqi::key_t key1, mqi::key_t key2, double value) {
+        this->add(key1, key2, &value, 1);
+    }
+
+    ///< Accumulate the n quantities v of a deposit under one key; ignored when
+    ///< v[0] is not positive
+    CUDA_HOST
+    void
+    add(mqi::key_t key1, mqi::key_t key2, const double* v, uint8_t n) {
+        if (v[0] <= 0) return;
+        if (n > n_values_) this->widen(n);
+        const uint64_t key  = pack(key1, key2);
+        const uint64_t mask = keys_.size() - 1;
+        uint64_t       slot = hash(key) & mask;
+        while (true) {
+            if (keys_[slot] == key) break;
+            if (keys_[slot] == empty_key) {
+                if (2 * (size_ + 1) > keys_.size()) {
+                    this->grow();
+                    this->add(key1, key2, v, n);
+                    return;
+                }
+                keys_[slot] = key;
+                ++size_;
+                break;
+            }
+            slot = (slot + 1) & mask;
+        }
+        double* values = &values_[slot * n_values_];
+        for (uint8_t q = 0; q < n; ++q)
+            values[q] += v[q];
+    }
+
+    ///< Remove all entries but keep the allocated capacity for the next batch
+    CUDA_HOST
+    void
+    clear() {
+        if (size_ == 0) return;
+        std::fill(keys_.begin(), keys_.end(), empty_key);
+        std::fill(values_.begin(), values_.end(), 0.0);
+        size_ = 0;
+    }
+
+    ///< Number of distinct keys
+    CUDA_HOST
+    size_t
+    size() const {
+        return size_;
+    }
+
+    ///< Quantities per key
+    CUDA_HOST
+    uint8_t
+    n_values() const {
+        return n_values_;
+    }
+
+    ///< Visit every entry as f(key1, key2, value) in slot order
+    template<class F>
+    CUDA_HOST void
+    for_each(F f) const {
+        this->for_each_values([&](mqi::key_t key1, mqi::key_t key2, const double* v) {
+            f(key1, key2, v[0]);
+        });
+    }
+
+    ///< Visit every entry as f(key1, key2, v) with its n_values() quantities
+    template<class F>
+    CUDA_HOST void
+    for_each_values(F f) const {
+        for (size_t i = 0; i < keys_.size(); ++i) {
+            if (keys_[i] == empty_key) continue;
+            f(static_cast<mqi::key_t>(keys_[i] >> 32),
+              static_cast<mqi::key_t>(keys_[i] & 0xffffffff),
+              &values_[i * n_values_]);
+        }
+    }
+
+private:
+    static constexpr uint64_t empty_key = 0xffffffffffffffffULL;
+
+    std::vector<uint64_t> keys_;
+    std::vector<double>   values_;   ///< n_values_ per slot
+    size_t                size_     = 0;
+    uint8_t               n_values_ = 1;
+
+    CUDA_HOST
+    static uint64_t
+    pack(mqi::key_t key1, mqi::key_t key2) {
+        return (static_cast<uint64_t>(key1) << 32) | key2;
+    }
+
+    ///< Fibonacci hashing, top bits are mixed down for power-of-two tables
+    CUDA_HOST
+    static uint64_t
+    hash(uint64_t key) {
+        key *= 0x9e3779b97f4a7c15ULL;
+        return key ^ (key >> 29);
+    }
+
+    CUDA_HOST
+    void
+    grow() {
+        std::vector<uint64_t> old_keys(2 * keys_.size(), empty_key);
+        std::vector<double>   old_values(2 * values_.size(), 0.0);
+        old_keys.swap(keys_);
+        old_values.swap(values_);
+        const uint64_t mask = keys_.size() - 1;
+        for (size_t i = 0; i < old_keys.size(); ++i) {
+            if (old_keys[i] == empty_key) continue;
+            uint64_t slot = hash(old_keys[i]) & mask;
+            while (keys_[slot] != empty_key)
+                slot = (slot + 1) & mask;
+            keys_[slot] = old_keys[i];
+            std::copy_n(&old_values[i * n_values_], n_values_, &values_[slot * n_values_]);
+        }
+    }
+
+    ///< Room for n quantities per slot, keeping the existing ones
+    CUDA_HOST
+    void
+    widen(uint8_t n) {
+        std::vector<double> values(keys_.size() * n, 0.0);
+        for (size_t i = 0; i < keys_.size(); ++i)
+            std::copy_n(&values_[i * n_values_], n_values_, &values[i * n]);
+        values_.swap(values);
+        n_values_ = n;
+    }
+};
+
+}   // namespace mqi
+
+#endif
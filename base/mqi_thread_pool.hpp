@@ -0,0 +1,134 @@
+#ifndef MQI_THREAD_POOL_HPP
+#define MQI_THREAD_POOL_HPP
+
+/// \file
+///
+/// A fixed-size pool of CPU worker threads for the host transport backend.
+/// Workers are created once and reused for every batch, so launching a batch
+/// only costs a wake-up instead of a thread creation per core.
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <moqui/base/mqi_common.hpp>
+
+namespace mqi
+{
+
+///< Number of CPU threads to use for a requested value (e.g. TotalThreads).
+///< A non-positive request selects all hardware threads.
+inline uint32_t
+cpu_thread_count(int requested) {
+    if (requested > 0) return static_cast<uint32_t>(requested);
+    uint32_t n = std::thread::hardware_concurrency();
+    return (n > 0) ? n : 1;
+}
+
+/// \class thread_pool
+///
+/// Runs the same job on every thread of the pool, or on its first threads only,
+/// and waits for them. The calling thread takes part in the job as thread 0, so a
+/// pool of size N owns N-1 background workers.
+class thread_pool
+{
+public:
+    ///< job signature: (thread_id, total_threads)
+    typedef std::function<void(uint32_t, uint32_t)> job_t;
+
+    CUDA_HOST
+    explicit thread_pool(uint32_t n_threads) : size_(n_threads > 0 ? n_threads : 1) {
+        workers_.reserve(size_ - 1);
+        for (uint32_t tid = 1; tid < size_; ++tid) {
+            workers_.emplace_back(&thread_pool::worker_loop, this, tid);
+        }
+    }
+
+    CUDA_HOST
+    ~thread_pool() {
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            stop_ = true;
+        }
+        cv_start_.notify_all();
+        for (auto& w : workers_)
+            w.join();
+    }
+
+    thread_pool(const thread_pool&) = delete;
+    thread_pool&
+    operator=(const thread_pool&) = delete;
+
+    ///< Total number of threads including the caller
+    CUDA_HOST
+    uint32_t
+    size() const {
+        return size_;
+    }
+
+    ///< Execute job(thread_id, n_active) on threads 0 .. n_active - 1 and block until
+    ///< they return; the other workers stay asleep. 0 (default) runs all threads.
+    CUDA_HOST
+    void
+    run(const job_t& job, uint32_t n_active = 0) {
+        if (n_active == 0 || n_active > size_) n_active = size_;
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            job_     = &job;
+            active_  = n_active;
+            pending_ = n_active - 1;
+            ++generation_;
+        }
+        if (n_active > 1) cv_start_.notify_all();
+
+        job(0, n_active);
+
+        std::unique_lock<std::mutex> lock(mtx_);
+        cv_done_.wait(lock, [this] { return pending_ == 0; });
+        job_ = nullptr;
+    }
+
+private:
+    CUDA_HOST
+    void
+    worker_loop(uint32_t tid) {
+        uint64_t seen = 0;
+        while (true) {
+            const job_t* job;
+            uint32_t     active;
+            {
+                std::unique_lock<std::mutex> lock(mtx_);
+                cv_start_.wait(lock, [&] {
+                    return stop_ || (generation_ != seen && tid < active_);
+                });
+                if (stop_) return;
+                seen   = generation_;
+                job    = job_;
+                active = active_;
+            }
+            (*job)(tid, active);
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                if (--pending_ == 0) cv_done_.notify_one();
+            }
+        }
+    }
+
+    const uint32_t           size_;
+    std::vector<std::thread> workers_;
+    std::mutex               mtx_;
+    std::condition_variable  cv_start_;
+    std::condition_variable  cv_done_;
+    const job_t*             job_        = nullptr;
+    uint64_t                 generation_ = 0;
+    uint32_t                 active_     = 0;   ///< threads taking part in the current job
+    uint32_t                 pending_    = 0;
+    bool                     stop_       = false;
+};
+
+}   // namespace mqi
+
+#endif
@@ -26,9 +26,11 @@ initialize_threads(mqi::thrd_t*   thrds,
     uint32_t thread_id = blockIdx.x * blockDim.x + threadIdx.x;
     curand_init(master_seed + blockIdx.x, threadIdx.x, offset, &thrds[thread_id].rnd_generator);
 #else
+    ///< offset is the beam number of the key; each thread starts on its own stream,
+    ///< which transport_histories replaces by the stream of every history
     for (uint32_t i = 0; i < n_threads; ++i) {
-        std::seed_seq seed{ master_seed + i };
-        thrds[i].rnd_generator.seed(master_seed);
+        thrds[i].rnd_generator.seed(uint32_t(master_seed), uint32_t(offset));
+        thrds[i].rnd_generator.stream(i, ~uint64_t(0));
     }
 #endif
 }
@@ -8,7 +8,7 @@ namespace mqi
 {
 
 ///< Particle type
-typedef enum
+typedef enum : uint8_t
 {
     PHOTON   = 0,
     ELECTRON = 1,
@@ -19,7 +19,7 @@ typedef enum
 //PDG[PROTON] = 2212 //
 
 ///< Process type
-typedef enum
+typedef enum : uint8_t
 {
     BEGIN    = 0,
     MAX_STEP = 1,
@@ -38,7 +38,7 @@ typedef enum
 ///< ALIVE   : under tracking
 ///< STOPPED : no further tracking is required due to limitation, e.g., cut
 ///< KILLED  : no further tracking is required due to energy 0 or exit world boundary?
-typedef enum
+typedef enum : uint8_t
 {
     CREATED = 0,   ///< created
     STOPPED = 3    ///< stopped by physics process
@@ -47,11 +47,23 @@ typedef enum
 ///< Track class
 /// pointer to geometry where current track is placed
 /// pre-/post- vertex points: vtx0 vtx1
+///
+/// Hot fields first: the vertices and deposits every step reads and writes
+/// fill the first cache line (float), the geometry state and bookkeeping the
+/// second one. The voxel traversal state (dda_t) is only valid inside a node
+/// and stays with the transport loop instead of travelling through the stack.
 
 template<typename R>
-class track_t
+class alignas(64) track_t
 {
 public:
+    vertex_t<R> vtx0;               ///< vertex pre
+    vertex_t<R> vtx1;               ///< vertex post
+    R           dE       = 0.0;     ///< total energy deposit between vtx0 to vtx1
+    R           local_dE = 0.0;     ///< total energy deposit between vtx0 to vtx1
+
+    intersect_t<R> its;   ///< geometry information, intersection, copy number
+
     uint32_t  scorer_column;   ///< id of beamlet or time-index can be used for Dij or Dit matrix
     status_t  status;          ///< particle status
     process_t process;         ///< id of physics process that limit the step,
@@ -59,29 +71,19 @@ public:
     bool       primary;
     particle_t particle;   ///< particle type,
 
-    vertex_t<R> vtx0;   ///< vertex pre
-    vertex_t<R> vtx1;   ///< vertex post
-
-    R          dE       = 0.0;       ///< total energy deposit between vtx0 to vtx1
-    R          local_dE = 0.0;       ///< total energy deposit between vtx0 to vtx1
-    node_t<R>* c_node   = nullptr;   ///< current node
+    node_t<R>* c_node = nullptr;   ///< current node
 
-    intersect_t<R> its;   ///< geometry information, intersection, copy number
-
-    vec3<R> ref_vector = vec3<R>(0, 0, 1);
     ///< Defaut constructor
     CUDA_HOST_DEVICE
-    track_t() :
-        status(CREATED), process(BEGIN), primary(true), dE(0), scorer_column(0), local_dE(0) {
+    track_t() : scorer_column(0), status(CREATED), process(BEGIN), primary(true) {
         ;
     }
 
     ///< Constructor
     CUDA_HOST_DEVICE
     track_t(const vertex_t<R>& v) :
-        status(CREATED), process(BEGIN), primary(true), dE(0), scorer_column(0), local_dE(0) {
-        vtx0 = v;
-        vtx1 = v;
+        vtx0(v), vtx1(v), scorer_column(0), status(CREATED), process(BEGIN), primary(true) {
+        ;
     }
 
     ///< Constructor
@@ -93,32 +95,8 @@ public:
             vertex_t<R> v0,
             vertex_t<R> v1,
             const R&    dE) :
-        status(s),
-        process(p), primary(is_p), particle(t), vtx0(v0), vtx1(v1), dE(dE), scorer_column(0),
-        local_dE(0) {
-        ;
-    }
-
-    ///< copy constructor
-    CUDA_HOST_DEVICE
-    track_t(const track_t& rhs) {
-        scorer_column = rhs.scorer_column;
-        status        = rhs.status;
-        process       = rhs.process;
-        particle      = rhs.particle;
-        primary       = rhs.primary;
-        vtx0          = rhs.vtx0;
-        vtx1          = rhs.vtx1;
-        dE            = rhs.dE;
-        local_dE      = rhs.local_dE;
-        c_node        = rhs.c_node;
-        its           = rhs.its;
-        ref_vector    = rhs.ref_vector;
-    }
-
-    ///< Destructor
-    CUDA_HOST_DEVICE
-    ~track_t() {
+        vtx0(v0),
+        vtx1(v1), dE(dE), scorer_column(0), status(s), process(p), primary(is_p), particle(t) {
         ;
     }
 
@@ -154,8 +132,9 @@ public:
     CUDA_HOST_DEVICE
     void
     update_post_vertex_direction(const R& theta, const R& phi) {
-        mqi::mat3x3<R> m_local(0, theta, phi);
-        mqi::vec3<R>   d_local = m_local * ref_vector;   // rotate about the z-axis (dir)
+        const mqi::vec3<R> ref_vector(0, 0, 1);
+        mqi::mat3x3<R>     m_local(0, theta, phi);
+        mqi::vec3<R>       d_local = m_local * ref_vector;   // rotate about the z-axis (dir)
         d_local.normalize();
         mqi::mat3x3<R> m_global(ref_vector, vtx1.dir);   // match dir to vtx1.dir
         vtx1.dir = m_global * d_local;
@@ -195,6 +174,9 @@ public:
     }
 };
 
+static_assert(sizeof(track_t<float>) == 128, "track_t<float> is two cache lines");
+static_assert(sizeof(track_t<double>) == 192, "track_t<double> is three cache lines");
+
 ///< Check invalid direction in track
 template<typename R>
 CUDA_HOST_DEVICE void
@@ -1,26 +1,95 @@
-
 #ifndef MQI_TRACK_STACK_HPP
 #define MQI_TRACK_STACK_HPP
 
+/// \file
+///
+/// Stack of the tracks waiting to be transported in a history.
+///
+/// On the CPU the tracks live in heap segments, each as large as all the
+/// previous ones together, added when the stack is full; a stack kept across the
+/// histories of a thread reuses them, so no track is dropped and nothing is
+/// reserved per history. CUDA builds keep a small array in the thread's frame and
+/// continue in an optional per-thread overflow buffer (set_overflow_buffer); only
+/// when that one is full as well the track is dropped. In both, tracks do not move
+/// while they are on the stack, so the transport works on the top track in place
+/// and pushes the secondaries above it.
+///
+/// Both count their overflow events. The CPU stacks report them to
+/// track_stack_counters when they are destroyed, the CUDA ones to the counters
+/// of their track_stack_spill_t at the end of the thread.
+
 #include <moqui/base/mqi_node.hpp>
 #include <moqui/base/mqi_track.hpp>
 
+#if !defined(__CUDACC__)
+#include <atomic>
+#endif
+
 namespace mqi
 {
 
+#if !defined(__CUDACC__)
+///< Overflow accounting of the CPU stacks of the process
+struct track_stack_counters_t {
+    std::atomic<uint64_t> grown{ 0 };       ///< arena reallocations
+    std::atomic<uint32_t> max_depth{ 0 };   ///< deepest stack seen
+
+    void
+    reset() {
+        grown     = 0;
+        max_depth = 0;
+    }
+};
+
+inline track_stack_counters_t track_stack_counters;
+#endif
+
+///< Overflow buffer of the stack of a CUDA thread and the counters of all threads.
+///< A kernel gets the buffers of all its threads, capacity tracks each, and
+///< passes of_thread(id) to the transport.
+template<typename R>
+struct track_stack_spill_t {
+    track_t<R>* buffer   = nullptr;
+    uint32_t    capacity = 0;         ///< tracks per thread
+    uint32_t*   counters = nullptr;   ///< [0] pushes that spilled, [1] tracks dropped
+
+    CUDA_HOST_DEVICE
+    track_stack_spill_t<R>
+    of_thread(uint32_t thread_id) const {
+        track_stack_spill_t<R> s = *this;
+        if (buffer) s.buffer = buffer + size_t(thread_id) * capacity;
+        return s;
+    }
+};
+
 template<typename R>
 class track_stack_t
 {
 
 public:
+    uint32_t idx        = 0;   /// empty : 0, 1-st element : 1
+    uint32_t max_depth  = 0;   ///< deepest idx reached
+    uint32_t n_overflow = 0;   ///< pushes that found the storage full (grown or spilled)
+    uint32_t n_dropped  = 0;   ///< pushes lost because no storage was left
+
+#if defined(__CUDACC__)
 #ifdef __PHYSICS_DEBUG__
-    const uint16_t limit = 200;
-    track_t<R>     tracks[200];
+    static constexpr uint16_t limit = 200;
 #else
-    const uint16_t limit = 10;
-    track_t<R>     tracks[10];
+    static constexpr uint16_t limit = 10;
 #endif
-    uint16_t idx = 0;   /// empty : 0, 1-st element : 1
+    track_t<R>  tracks[limit];
+    track_t<R>* spill          = nullptr;   ///< per-thread overflow buffer
+    uint32_t    spill_capacity = 0;
+#else
+    static constexpr uint32_t initial_capacity = 16;
+    static constexpr uint32_t max_segments     = 28;
+    ///< segment 0 holds tracks [0, 16), segment k > 0 tracks [16 << (k-1), 16 << k)
+    track_t<R>* segments[max_segments] = {};
+    uint32_t    n_segments             = 0;
+    uint32_t    capacity               = 0;
+#endif
+
     CUDA_HOST_DEVICE
     track_stack_t() {
         ;
@@ -28,17 +97,49 @@ public:
 
     CUDA_HOST_DEVICE
     ~track_stack_t() {
-        ;
+#if !defined(__CUDACC__)
+        if (n_overflow > 0) track_stack_counters.grown += n_overflow;
+        uint32_t seen = track_stack_counters.max_depth.load(std::memory_order_relaxed);
+        while (max_depth > seen &&
+               !track_stack_counters.max_depth.compare_exchange_weak(seen, max_depth)) {
+            ;
+        }
+        for (uint32_t k = 0; k < n_segments; ++k)
+            delete[] segments[k];
+#endif
     }
 
+    track_stack_t(const track_stack_t&) = delete;
+    track_stack_t&
+    operator=(const track_stack_t&) = delete;
+
+#if defined(__CUDACC__)
+    ///< Continue in buf (capacity tracks) when the frame array is full
     CUDA_HOST_DEVICE
     void
-    push_secondary(const track_t<R>& trk) {
+    set_overflow_buffer(track_t<R>* buf, uint32_t buf_capacity) {
+        spill          = buf;
+        spill_capacity = buf_capacity;
+    }
+#endif
 
-        if (idx < limit) {
-            tracks[idx] = trk;
-            ++idx;
+    CUDA_HOST_DEVICE
+    void
+    push_secondary(const track_t<R>& trk) {
+#if defined(__CUDACC__)
+        if (idx >= limit) {
+            if (idx == limit) n_overflow++;
+            if (idx - limit >= spill_capacity) {
+                n_dropped++;
+                return;
+            }
         }
+#else
+        if (idx == capacity) grow();
+#endif
+        (*this)[idx] = trk;
+        ++idx;
+        if (idx > max_depth) max_depth = idx;
     }
 
     CUDA_HOST_DEVICE
@@ -47,18 +148,53 @@ public:
         return idx == 0;
     }
 
+    ///< Removes the top track. The reference stays valid until the next push,
+    ///< so a caller that does not push meanwhile uses it without a copy.
     CUDA_HOST_DEVICE
-    track_t<R>
+    track_t<R>&
     pop(void) {
-        ///copy
-        return tracks[--idx];
+        return (*this)[--idx];
+    }
+
+    ///< Top track, in place. It stays valid while tracks are pushed above it.
+    CUDA_HOST_DEVICE
+    track_t<R>&
+    top(void) {
+        return (*this)[idx - 1];
+    }
+
+    ///< Removes track i; the top track takes its place
+    CUDA_HOST_DEVICE
+    void
+    remove(uint32_t i) {
+        --idx;
+        if (i != idx) (*this)[i] = (*this)[idx];
     }
 
     CUDA_HOST_DEVICE
     track_t<R>&
-    operator[](uint16_t i) {
-        return tracks[i];
+    operator[](uint32_t i) {
+#if defined(__CUDACC__)
+        return (i < limit) ? tracks[i] : spill[i - limit];
+#else
+        const uint32_t q = i / initial_capacity;
+        if (q == 0) return segments[0][i];
+        const uint32_t k = 32 - __builtin_clz(q);
+        return segments[k][i - (initial_capacity << (k - 1))];
+#endif
+    }
+
+#if !defined(__CUDACC__)
+private:
+    ///< Adds a segment as large as the stack so far; the tracks stay in place
+    void
+    grow() {
+        const uint32_t size = (capacity == 0) ? initial_capacity : capacity;
+        segments[n_segments++] = new track_t<R>[size];
+        if (capacity > 0) n_overflow++;
+        capacity += size;
     }
+#endif
 };
 
 }   // namespace mqi
@@ -116,12 +116,14 @@ protected:
                          const mqi::beam_module_ion::spot& s1) = 0;
 
     /// User method to characterize MODULATED beamlet based on spot information from Log.
+    /// \param arena : arena of the beamsource being created, holds the distributions
     // Connected to mqi_treatment_machine_smc_gtr2.hpp
     // Added in 2023 by Chanil Jeon
     virtual mqi::beamlet<T>
     characterize_beamlet(const mqi::beam_module_ion::logspot& s,
         const float                       source_to_isocenter_mm,
-        const bool rsuse) = 0;
+        const bool rsuse,
+        mqi::beamlet_arena<T>&            arena) = 0;
 };
 
 }   // namespace mqi
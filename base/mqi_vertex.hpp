@@ -17,15 +17,6 @@ struct vertex_t {
     T       ke;    //< kinetic energy
     vec3<T> pos;   //< position
     vec3<T> dir;   //< direction
-
-    CUDA_HOST_DEVICE
-    vertex_t<T>&
-    operator=(const vertex_t<T>& rhs) {
-        ke  = rhs.ke;
-        pos = rhs.pos;
-        dir = rhs.dir;
-        return *this;
-    }
 };
 
 }   // namespace mqi
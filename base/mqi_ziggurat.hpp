@@ -0,0 +1,141 @@
+#ifndef MQI_ZIGGURAT_HPP
+#define MQI_ZIGGURAT_HPP
+
+/// \file
+///
+/// Ziggurat samplers of the standard normal and exponential distributions
+/// (Marsaglia & Tsang, J. Stat. Softw. 5(8), 2000).
+///
+/// The density is covered by 128 (normal) or 256 (exponential) layers of equal
+/// area. A 32-bit number selects the layer with its low bits and gives the
+/// abscissa with its upper 24 bits, so about 99% of the samples cost one number,
+/// one compare and one multiply. Only the wedges and the tail need exp/log.
+/// The tables are built once on the host; this is the CPU sampler, CUDA builds
+/// keep curand.
+
+#include <moqui/base/mqi_common.hpp>
+
+#include <cmath>
+
+namespace mqi
+{
+
+/// \class ziggurat
+class ziggurat
+{
+public:
+    static constexpr double m = 16777216.0;   ///< 2^24, resolution of the abscissa
+
+    uint32_t kn[128];   ///< normal: accept m < kn[layer] at once
+    float    wn[128];   ///< normal: layer width / m
+    float    fn[128];   ///< normal: density at the layer edges
+    uint32_t ke[256];   ///< exponential
+    float    we[256];
+    float    fe[256];
+
+    CUDA_HOST
+    ziggurat() {
+        ///< normal, right edge r of the base layer and area v of a layer
+        double       dn = 3.442619855899, tn = dn;
+        const double vn = 9.91256303526217e-3;
+        double       q  = vn / std::exp(-0.5 * dn * dn);
+        kn[0]           = uint32_t((dn / q) * m);
+        kn[1]           = 0;
+        wn[0]           = float(q / m);
+        wn[127]         = float(dn / m);
+        fn[0]           = 1.0f;
+        fn[127]         = float(std::exp(-0.5 * dn * dn));
+        for (int i = 126; i >= 1; --i) {
+            dn        = std::sqrt(-2.0 * std::log(vn / dn + std::exp(-0.5 * dn * dn)));
+            kn[i + 1] = uint32_t((dn / tn) * m);
+            tn        = dn;
+            fn[i]     = float(std::exp(-0.5 * dn * dn));
+            wn[i]     = float(dn / m);
+        }
+        ///< exponential
+        double       de = 7.697117470131487, te = de;
+        const double ve = 3.949659822581572e-3;
+        q               = ve / std::exp(-de);
+        ke[0]           = uint32_t((de / q) * m);
+        ke[1]           = 0;
+        we[0]           = float(q / m);
+        we[255]         = float(de / m);
+        fe[0]           = 1.0f;
+        fe[255]         = float(std::exp(-de));
+        for (int i = 254; i >= 1; --i) {
+            de        = -std::log(ve / de + std::exp(-de));
+            ke[i + 1] = uint32_t((de / te) * m);
+            te        = de;
+            fe[i]     = float(std::exp(-de));
+            we[i]     = float(de / m);
+        }
+    }
+
+    ///< Standard normal number
+    template<class G>
+    CUDA_HOST inline float
+    normal(G& gen) const {
+        for (;;) {
+            const uint32_t u     = gen();
+            const uint32_t layer = u & 127;
+            const uint32_t a     = u >> 8;
+            const float    sign  = (u & 128) ? -1.0f : 1.0f;
+            const float    x     = a * wn[layer];
+            if (a < kn[layer]) return sign * x;
+            if (layer == 0) {
+                ///< tail beyond r
+                const double r = 3.442619855899;
+                double       tx, ty;
+                do {
+                    tx = -std::log(open_uniform(gen)) / r;
+                    ty = -std::log(open_uniform(gen));
+                } while (ty + ty < tx * tx);
+                return sign * float(r + tx);
+            }
+            if (fn[layer] + open_uniform(gen) * (fn[layer - 1] - fn[layer]) <
+                std::exp(-0.5f * x * x)) {
+                return sign * x;
+            }
+        }
+    }
+
+    ///< Exponential number of unit mean
+    template<class G>
+    CUDA_HOST inline float
+    exponential(G& gen) const {
+        for (;;) {
+            const uint32_t u     = gen();
+            const uint32_t layer = u & 255;
+            const uint32_t a     = u >> 8;
+            const float    x     = a * we[layer];
+            if (a < ke[layer]) return x;
+            if (layer == 0) {
+                ///< the tail beyond r is an exponential shifted by r
+                return float(7.697117470131487 - std::log(open_uniform(gen)));
+            }
+            if (fe[layer] + open_uniform(gen) * (fe[layer - 1] - fe[layer]) < std::exp(-x)) {
+                return x;
+            }
+        }
+    }
+
+    ///< Tables shared by all threads
+    CUDA_HOST
+    static const ziggurat&
+    host() {
+        static const ziggurat tables;
+        return tables;
+    }
+
+private:
+    ///< (0, 1), safe for log
+    template<class G>
+    CUDA_HOST static inline double
+    open_uniform(G& gen) {
+        return ((gen() >> 8) + 0.5) * (1.0 / m);
+    }
+};
+
+}   // namespace mqi
+
+#endif
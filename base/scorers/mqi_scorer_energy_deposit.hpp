@@ -3,6 +3,7 @@
 
 #include <moqui/base/mqi_grid3d.hpp>
 #include <moqui/base/mqi_material.hpp>
+#include <moqui/base/mqi_scorer.hpp>
 #include <moqui/base/mqi_track.hpp>
 
 namespace mqi
@@ -129,6 +130,138 @@ LETt_weight2(const track_t<R>& trk, const cnb_t& cnb, grid3d<mqi::density_t, R>&
     return length;
 }
 
+///< Dose to water, LETd numerator and LETd denominator of a step (v[0..2]),
+///< reading the density and computing the step length once for the three
+template<typename R>
+CUDA_DEVICE inline void
+dose_LETd(const track_t<R>& trk, const cnb_t& cnb, grid3d<mqi::density_t, R>& geo, double* v) {
+    v[0] = v[1] = v[2] = 0.0;
+    const R density = geo.get_data()[cnb];
+    if (density < 1.0e-7) return;
+    mqi::h2o_t<R> water;
+    water.rho_mass = density;
+    v[0]           = (trk.dE + trk.local_dE) * 1.60218e-10 /
+           (geo.get_volume(cnb) * density * water.stopping_power_ratio(trk.vtx0.ke));
+    double length = (trk.vtx1.pos.x - trk.vtx0.pos.x) * (trk.vtx1.pos.x - trk.vtx0.pos.x);
+    length += (trk.vtx1.pos.y - trk.vtx0.pos.y) * (trk.vtx1.pos.y - trk.vtx0.pos.y);
+    length += (trk.vtx1.pos.z - trk.vtx0.pos.z) * (trk.vtx1.pos.z - trk.vtx0.pos.z);
+    length = mqi::mqi_sqrt(length);
+    if (length <= 0) return;
+    const R      rho = density * R(1000.0);
+    const double let = trk.dE / length / rho;
+    if (let >= 25.0) return;
+    v[1] = trk.dE * let;
+    v[2] = trk.dE;
+}
+
+///< Hit computation of a scorer kind, selected at compile time so that the
+///< density, volume and stopping power ratio math is inlined into the caller
+template<typename R, hit_t H>
+struct hit_policy;
+
+template<typename R>
+struct hit_policy<R, ENERGY_DEPOSIT_HIT> {
+    CUDA_DEVICE static inline double
+    compute(const track_t<R>& trk, const cnb_t& cnb, grid3d<mqi::density_t, R>& geo) {
+        return energy_deposit<R>(trk, cnb, geo);
+    }
+};
+
+template<typename R>
+struct hit_policy<R, DOSE_TO_WATER_HIT> {
+    CUDA_DEVICE static inline double
+    compute(const track_t<R>& trk, const cnb_t& cnb, grid3d<mqi::density_t, R>& geo) {
+        return dose_to_water<R>(trk, cnb, geo);
+    }
+};
+
+template<typename R>
+struct hit_policy<R, DOSE_TO_MEDIUM_HIT> {
+    CUDA_DEVICE static inline double
+    compute(const track_t<R>& trk, const cnb_t& cnb, grid3d<mqi::density_t, R>& geo) {
+        return dose_to_medium<R>(trk, cnb, geo);
+    }
+};
+
+template<typename R>
+struct hit_policy<R, LETD_NUMERATOR_HIT> {
+    CUDA_DEVICE static inline double
+    compute(const track_t<R>& trk, const cnb_t& cnb, grid3d<mqi::density_t, R>& geo) {
+        return LETd_weight1<R>(trk, cnb, geo);
+    }
+};
+
+template<typename R>
+struct hit_policy<R, LETD_DENOMINATOR_HIT> {
+    CUDA_DEVICE static inline double
+    compute(const track_t<R>& trk, const cnb_t& cnb, grid3d<mqi::density_t, R>& geo) {
+        return LETd_weight2<R>(trk, cnb, geo);
+    }
+};
+
+template<typename R>
+struct hit_policy<R, TRACK_LENGTH_HIT> {
+    CUDA_DEVICE static inline double
+    compute(const track_t<R>& trk, const cnb_t& cnb, grid3d<mqi::density_t, R>& geo) {
+        return LETt_weight2<R>(trk, cnb, geo);
+    }
+};
+
+template<typename R>
+struct hit_policy<R, DOSE_LETD_HIT> {
+    ///< dose only, for callers scoring one quantity
+    CUDA_DEVICE static inline double
+    compute(const track_t<R>& trk, const cnb_t& cnb, grid3d<mqi::density_t, R>& geo) {
+        return dose_to_water<R>(trk, cnb, geo);
+    }
+};
+
+///< Hit value of a scorer. A known kind takes the inlined policy; the switch on
+///< a byte of the scorer is taken the same way for every step of a node, so it
+///< is predicted. GENERIC_HIT scorers keep the function pointer.
+template<typename R>
+CUDA_DEVICE inline double
+compute_hit(const scorer<R>&           scr,
+            const track_t<R>&          trk,
+            const cnb_t&               cnb,
+            grid3d<mqi::density_t, R>& geo) {
+    switch (scr.hit_) {
+    case DOSE_TO_WATER_HIT:
+        return hit_policy<R, DOSE_TO_WATER_HIT>::compute(trk, cnb, geo);
+    case ENERGY_DEPOSIT_HIT:
+        return hit_policy<R, ENERGY_DEPOSIT_HIT>::compute(trk, cnb, geo);
+    case DOSE_TO_MEDIUM_HIT:
+        return hit_policy<R, DOSE_TO_MEDIUM_HIT>::compute(trk, cnb, geo);
+    case LETD_NUMERATOR_HIT:
+        return hit_policy<R, LETD_NUMERATOR_HIT>::compute(trk, cnb, geo);
+    case LETD_DENOMINATOR_HIT:
+        return hit_policy<R, LETD_DENOMINATOR_HIT>::compute(trk, cnb, geo);
+    case TRACK_LENGTH_HIT:
+        return hit_policy<R, TRACK_LENGTH_HIT>::compute(trk, cnb, geo);
+    case DOSE_LETD_HIT:
+        return hit_policy<R, DOSE_LETD_HIT>::compute(trk, cnb, geo);
+    default:
+        return scr.compute_hit_(trk, cnb, geo);
+    }
+}
+
+///< All quantities of a scorer for a hit (v[0 .. n_quantities_ - 1]).
+///< Returns the number of quantities.
+template<typename R>
+CUDA_DEVICE inline uint8_t
+compute_hits(const scorer<R>&           scr,
+             const track_t<R>&          trk,
+             const cnb_t&               cnb,
+             grid3d<mqi::density_t, R>& geo,
+             double*                    v) {
+    if (scr.hit_ == DOSE_LETD_HIT) {
+        dose_LETd<R>(trk, cnb, geo, v);
+        return 3;
+    }
+    v[0] = compute_hit<R>(scr, trk, cnb, geo);
+    return 1;
+}
+
 #if defined(__CUDACC__)
 CUDA_DEVICE fp_compute_hit<mqi::phsp_t> energy_deposit_pointer = mqi::energy_deposit;
 CUDA_DEVICE fp_compute_hit<mqi::phsp_t> energy_deposit_primary_pointer =
@@ -5,6 +5,7 @@
 
 #include <moqui/kernel_functions/mqi_download_data.hpp>
 #include <moqui/kernel_functions/mqi_print_data.hpp>
+#include <moqui/kernel_functions/mqi_scoring_reduction.hpp>
 #include <moqui/kernel_functions/mqi_transport.hpp>
 #include <moqui/kernel_functions/mqi_upload_data.hpp>
 #include <moqui/kernel_functions/mqi_variables.hpp>
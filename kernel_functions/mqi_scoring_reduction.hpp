@@ -0,0 +1,104 @@
+#ifndef MQI_SCORING_REDUCTION_HPP
+#define MQI_SCORING_REDUCTION_HPP
+
+/// \file
+///
+/// Deterministic merge of private scoring buffers (CPU backend).
+///
+/// Buffers are laid out slice-major: the buffer of scorer b (numbered with
+/// scorer_base_index) for history slice i is buffers[i * n_scorers + b].
+/// Entries are first bucketed by voxel tile, then each tile is merged by one
+/// thread in increasing slice order. Every key receives its contributions in
+/// the same order whatever the number of threads doing the merge. Scorers with
+/// several quantities carry their companions in a parallel bucket.
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#include <moqui/base/mqi_scoring_buffer.hpp>
+#include <moqui/base/mqi_thread_pool.hpp>
+#include <moqui/kernel_functions/mqi_transport.hpp>
+
+namespace mc
+{
+
+///< Total number of scorers of the world children (size of a slice in buffers)
+template<typename R>
+CUDA_HOST inline uint32_t
+total_scorers(const mqi::node_t<R>* world) {
+    return scorer_base_index(world, world->n_children);
+}
+
+///< Merge buffers of n_slices slices into the scorer tables and clear the buffers.
+template<typename R>
+CUDA_HOST void
+reduce_scoring_buffers(mqi::thread_pool&    pool,
+                       mqi::node_t<R>*      world,
+                       mqi::scoring_buffer* buffers,
+                       uint32_t             n_slices) {
+    struct entry_t {
+        mqi::key_t key1;
+        mqi::key_t key2;
+        double     value;
+    };
+    const uint32_t n_scorers = total_scorers(world);
+    const uint32_t n_tiles   = 4 * pool.size();
+
+    for (uint32_t c_ind = 0; c_ind < world->n_children; ++c_ind) {
+        mqi::node_t<R>* child = world->children[c_ind];
+        const uint32_t  base  = scorer_base_index(world, c_ind);
+        const uint64_t  n_voxels =
+          uint64_t(child->geo->get_nxyz().x) * child->geo->get_nxyz().y * child->geo->get_nxyz().z;
+        for (uint32_t s = 0; s < child->n_scorers; ++s) {
+            mqi::scorer<R>* scr = child->scorers[s];
+
+            ///< quantities kept per entry: companions only reach a table that stores them
+            const uint8_t n_values = (scr->quantities_ != nullptr) ? scr->n_quantities_ : 1;
+
+            ///< 1. bucket every slice by voxel tile (parallel over slices)
+            std::vector<std::vector<entry_t>> buckets(size_t(n_slices) * n_tiles);
+            std::vector<std::vector<double>>  companions(n_values > 1 ? buckets.size() : 0);
+            pool.run([&](uint32_t thread_id, uint32_t total_threads) {
+                for (uint32_t slice = thread_id; slice < n_slices; slice += total_threads) {
+                    mqi::scoring_buffer& buffer = buffers[size_t(slice) * n_scorers + base + s];
+                    const uint8_t        n_kept = std::min(n_values, buffer.n_values());
+                    buffer.for_each_values([&](mqi::key_t key1, mqi::key_t key2, const double* v) {
+                        uint64_t tile = uint64_t(key1) * n_tiles / n_voxels;
+                        if (tile >= n_tiles) tile = n_tiles - 1;
+                        const size_t b = size_t(slice) * n_tiles + tile;
+                        buckets[b].push_back({ key1, key2, v[0] });
+                        for (uint8_t q = 1; q < n_values; ++q)
+                            companions[b].push_back(q < n_kept ? v[q] : 0.0);
+                    });
+                    buffer.clear();
+                }
+            });
+
+            ///< 2. merge each tile in slice order (parallel over tiles)
+            std::atomic<uint32_t> next_tile(0);
+            pool.run([&](uint32_t, uint32_t) {
+                for (uint32_t tile = next_tile++; tile < n_tiles; tile = next_tile++) {
+                    for (uint32_t slice = 0; slice < n_slices; ++slice) {
+                        const size_t b = size_t(slice) * n_tiles + tile;
+                        for (size_t i = 0; i < buckets[b].size(); ++i) {
+                            const entry_t& e = buckets[b][i];
+                            if (n_values == 1) {
+                                score_hit<R>(scr, e.key1, e.key2, e.value, n_voxels);
+                                continue;
+                            }
+                            double v[mqi::scorer<R>::max_quantities] = { e.value };
+                            for (uint8_t q = 1; q < n_values; ++q)
+                                v[q] = companions[b][i * (n_values - 1) + q - 1];
+                            score_hits<R>(scr, e.key1, e.key2, v, n_values, n_voxels);
+                        }
+                    }
+                }
+            });
+        }
+    }
+}
+
+}   // namespace mc
+
+#endif
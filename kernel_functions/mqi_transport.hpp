@@ -5,12 +5,16 @@
 #include <moqui/base/mqi_fippel_physics.hpp>
 #include <moqui/base/mqi_material.hpp>
 #include <moqui/base/mqi_node.hpp>
+#include <moqui/base/mqi_scoring_buffer.hpp>
 #include <moqui/base/mqi_threads.hpp>
 #include <moqui/base/mqi_track.hpp>
 #include <moqui/base/mqi_utils.hpp>
 #include <moqui/base/mqi_vertex.hpp>
+#include <moqui/base/scorers/mqi_scorer_energy_deposit.hpp>
 
 #include <cassert>
+#include <cstddef>
+#include <cstring>
 
 namespace mc
 {
@@ -37,14 +41,39 @@ hash_fun(uint32_t k1, uint32_t k2, uint64_t max_capacity) {
 CUDA_HOST_DEVICE
 uint32_t
 CAS(uint32_t* address, uint32_t compare, uint32_t val) {
+#if defined(__CUDACC__)
     uint32_t old = *address;
     if (old == compare) {
         *address = val;
     } else {
     }
     return old;
+#else
+    ///< host threads share the scorer table
+    return __sync_val_compare_and_swap(address, compare, val);
+#endif
+}
+
+///< atomic add of a double for host threads (no native fetch_add for floating point)
+CUDA_HOST
+inline void
+atomic_add_host(double* address, double val) {
+    uint64_t* bits     = reinterpret_cast<uint64_t*>(address);
+    uint64_t  expected = __atomic_load_n(bits, __ATOMIC_RELAXED);
+    uint64_t  desired;
+    double    sum;
+    do {
+        std::memcpy(&sum, &expected, sizeof(double));
+        sum += val;
+        std::memcpy(&desired, &sum, sizeof(double));
+    } while (!__atomic_compare_exchange_n(
+      bits, &expected, desired, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
 }
 
+///< key1 and key2 are claimed together with one 64-bit compare-and-swap of the
+///< first 8 bytes of the slot (key1 in the low half on little-endian hosts and GPUs),
+///< so two threads cannot each claim half of an empty slot.
+///< slot_out, if given, receives the slot the value was added to
 template<typename R>
 CUDA_DEVICE void
 insert_hashtable(mqi::key_value*        hashtable,
@@ -52,7 +81,8 @@ insert_hashtable(mqi::key_value*        hashtable,
                  mqi::key_t             key2,
                  double                 value,
                  unsigned long long int scorer_offset,
-                 uint64_t               max_capacity) {
+                 uint64_t               max_capacity,
+                 mqi::key_t*            slot_out = nullptr) {
     mqi::key_t slot;
     if (value <= 0) { return; }
     if (key2 == mqi::empty_pair) {
@@ -62,78 +92,525 @@ insert_hashtable(mqi::key_value*        hashtable,
         slot = hash_fun(key1, key2, max_capacity);
     }
 
-    uint32_t prev1, prev2;
+    static_assert(offsetof(mqi::key_value, key2) == sizeof(mqi::key_t),
+                  "key1 and key2 must share one 64-bit word");
+    const uint64_t empty = (uint64_t(mqi::empty_pair) << 32) | mqi::empty_pair;
+    const uint64_t key   = (uint64_t(key2) << 32) | key1;
+    uint64_t       prev;
     while (true) {
+        uint64_t* address = reinterpret_cast<uint64_t*>(&hashtable[slot].key1);
 #if defined(__CUDACC__)
-        prev1 = atomicCAS(&hashtable[slot].key1, mqi::empty_pair, key1);
-        prev2 = atomicCAS(&hashtable[slot].key2, mqi::empty_pair, key2);
+        prev = atomicCAS(reinterpret_cast<unsigned long long*>(address), empty, key);
 #else
-        prev1 = CAS(&hashtable[slot].key1, mqi::empty_pair, key1);
-        prev2 = CAS(&hashtable[slot].key2, mqi::empty_pair, key2);
+        prev = __sync_val_compare_and_swap(address, empty, key);
 #endif
-        if ((prev1 == mqi::empty_pair || prev1 == key1) &&
-            (prev2 == mqi::empty_pair || prev2 == key2)) {
+        if (prev == empty || prev == key) {
 #if defined(__CUDACC__)
             atomicAdd(&hashtable[slot].value, value);
 #else
-            hashtable[slot].value += value;
+            atomic_add_host(&hashtable[slot].value, value);
 #endif
+            if (slot_out) *slot_out = slot;
             return;
         }
         slot = (slot + 1) % (max_capacity);
     }
 }
 
+///< Insert into a packed_table: a single 64-bit compare-and-swap claims (key1, key2).
+///< Probing goes on past max_probe_ (counted in long_probes_) through the whole table.
+///< Returns false only if every slot holds another key (counted in overflow_).
+///< slot_out, if given, receives the slot the value was added to.
+CUDA_DEVICE
+inline bool
+insert_packed_table(mqi::packed_table* table,
+                    mqi::key_t         key1,
+                    mqi::key_t         key2,
+                    double             value,
+                    uint32_t*          slot_out = nullptr) {
+    if (value <= 0) { return true; }
+    uint32_t slot = table->home_slot(key1, key2);
+    if (key2 == mqi::empty_pair) key2 = 0;
+    const uint64_t key = mqi::packed_table::pack(key1, key2);
+
+    for (uint32_t probe = 0; probe < table->capacity_; ++probe) {
+        uint64_t* address = &table->keys_[slot];
+#if defined(__CUDACC__)
+        uint64_t prev = atomicCAS(reinterpret_cast<unsigned long long*>(address),
+                                  mqi::packed_table::empty_key,
+                                  key);
+#else
+        uint64_t prev = __atomic_load_n(address, __ATOMIC_ACQUIRE);
+        if (prev == mqi::packed_table::empty_key) {
+            ///< on failure prev receives the key that won the slot
+            __atomic_compare_exchange_n(
+              address, &prev, key, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+        }
+#endif
+        if (prev == mqi::packed_table::empty_key || prev == key) {
+#if defined(__CUDACC__)
+            if (probe >= table->max_probe_) atomicAdd(&table->long_probes_, 1ULL);
+            atomicAdd(&table->values_[slot], value);
+#else
+            if (probe >= table->max_probe_) {
+                __atomic_fetch_add(&table->long_probes_, 1ULL, __ATOMIC_RELAXED);
+            }
+            atomic_add_host(&table->values_[slot], value);
+#endif
+            if (slot_out) *slot_out = slot;
+            return true;
+        }
+        slot = (slot + 1 == table->capacity_) ? 0 : slot + 1;
+    }
+#if defined(__CUDACC__)
+    atomicAdd(&table->overflow_, 1ULL);
+#else
+    __atomic_fetch_add(&table->overflow_, 1ULL, __ATOMIC_RELAXED);
+#endif
+    return false;
+}
+
+///< Score a hit into the table of a scorer (dense array, packed table or key_value table)
 template<typename R>
-CUDA_GLOBAL void
-transport_particles_patient(mqi::thrd_t*      threads,
-                            mqi::node_t<R>*   world,
-                            mqi::vertex_t<R>* vertices,
-                            const uint32_t    n_vtx,
-                            uint32_t*         tracked_particles,
-                            uint32_t*         scorer_offset_vector = nullptr,
-                            bool              score_local_deposit  = true,
-                            uint32_t          total_threads        = 1,   // # of CPU threads
-                            uint32_t          thread_id            = 0)                       // CPU thread-id
-{
+CUDA_DEVICE inline void
+score_hit(mqi::scorer<R>* scr, mqi::key_t key1, mqi::key_t key2, double value, uint64_t n_voxels) {
+    if (scr->dense_ != nullptr) {
+        ///< dense arrays are only set up for per-voxel deposits (key2 == empty_pair)
+        if (value <= 0) return;
+#if defined(__CUDACC__)
+        atomicAdd(&scr->dense_[key1], value);
+#else
+        atomic_add_host(&scr->dense_[key1], value);
+#endif
+    } else if (scr->packed_ != nullptr) {
+        insert_packed_table(scr->packed_, key1, key2, value);
+    } else {
+        insert_hashtable<R>(scr->data_, key1, key2, value, n_voxels, scr->max_capacity_);
+    }
+}
 
+///< Score the quantities v[0 .. n - 1] of a hit under one key: one probe finds the
+///< slot of v[0] and the companions are added to the same slot of quantities_
+template<typename R>
+CUDA_DEVICE inline void
+score_hits(mqi::scorer<R>* scr,
+           mqi::key_t      key1,
+           mqi::key_t      key2,
+           const double*   v,
+           uint8_t         n,
+           uint64_t        n_voxels) {
+    if (n == 1 || scr->quantities_ == nullptr) {
+        score_hit<R>(scr, key1, key2, v[0], n_voxels);
+        return;
+    }
+    if (v[0] <= 0) return;
+    mqi::key_t slot = key1;
+    if (scr->dense_ != nullptr) {
+        score_hit<R>(scr, key1, key2, v[0], n_voxels);
+    } else if (scr->packed_ != nullptr) {
+        if (!insert_packed_table(scr->packed_, key1, key2, v[0], &slot)) return;
+    } else {
+        insert_hashtable<R>(scr->data_, key1, key2, v[0], n_voxels, scr->max_capacity_, &slot);
+    }
+    for (uint8_t q = 1; q < n; ++q) {
+        if (v[q] == 0) continue;
+        double* address = &scr->quantities_[(q - 1) * size_t(scr->max_capacity_) + slot];
 #if defined(__CUDACC__)
-    ///< Thread id and total number of threads are replaced in CUDA
-    thread_id     = blockIdx.x * blockDim.x + threadIdx.x;
-    total_threads = (blockDim.x * gridDim.x);
+        atomicAdd(address, v[q]);
+#else
+        atomic_add_host(address, v[q]);
 #endif
+    }
+}
 
-    const mqi::vec2<uint32_t> h_range    = mqi::start_and_length(total_threads, n_vtx, thread_id);
-    mqi::mqi_rng*             thread_rng = &threads[thread_id].rnd_generator;
-    R                         process;
+///< Index of the first scorer of world->children[c_ind] when the scorers of all
+///< children are numbered consecutively (layout of private scoring buffers)
+template<typename R>
+CUDA_HOST_DEVICE inline uint32_t
+scorer_base_index(const mqi::node_t<R>* world, uint32_t c_ind) {
+    uint32_t base = 0;
+    for (uint32_t c = 0; c < c_ind; ++c)
+        base += world->children[c]->n_scorers;
+    return base;
+}
+
+///< Deposits of the consecutive steps of a track in one voxel, summed per scorer.
+///< The scorer tables sum the hit values anyway, so adding them here first and
+///< inserting once when the track leaves the voxel (flush_deposits) gives the
+///< same totals with one table operation and one ROI lookup per voxel.
+template<typename R>
+struct deposit_accumulator_t {
+    static constexpr uint8_t max_scorers = 8;   ///< nodes with more are scored per step
+
+    mqi::node_t<R>*                 node = nullptr;   ///< nullptr: nothing pending
+    mqi::grid3d<mqi::density_t, R>* geo;
+    mqi::cnb_t                      cnb;
+    uint32_t                        spot_ind;
+    mqi::scoring_buffer*            private_scoring;
+    uint32_t                        scorer_base;
+    uint8_t                         n_values[max_scorers];   ///< quantities of each scorer
+    ///< value[s][0] < 0: voxel outside the ROI of scorer s
+    double   value[max_scorers][mqi::scorer<R>::max_quantities];
+    uint64_t n_steps   = 0;   ///< steps added
+    uint64_t n_flushes = 0;   ///< voxels scored
+};
+
+///< Score the n quantities of a hit of a scorer of the node into a private buffer
+///< or the shared table
+template<typename R>
+CUDA_DEVICE inline void
+score_node_hit(mqi::node_t<R>*                 node,
+               uint8_t                         s,
+               mqi::grid3d<mqi::density_t, R>& c_geo,
+               mqi::cnb_t                      cnb,
+               uint32_t                        spot_ind,
+               const double*                   v,
+               uint8_t                         n,
+               mqi::scoring_buffer*            private_scoring,
+               uint32_t                        scorer_base) {
+#if !defined(__CUDACC__)
+    if (private_scoring) {
+        private_scoring[scorer_base + s].add(cnb, spot_ind, v, n);
+        return;
+    }
+#endif
+    score_hits<R>(node->scorers[s],
+                  cnb,
+                  spot_ind,
+                  v,
+                  n,
+                  c_geo.get_nxyz().x * c_geo.get_nxyz().y * c_geo.get_nxyz().z);
+}
+
+///< Score the pending deposits of the accumulator
+template<typename R>
+CUDA_DEVICE inline void
+flush_deposits(deposit_accumulator_t<R>& acc) {
+    if (acc.node == nullptr) return;
+    for (uint8_t s = 0; s < acc.node->n_scorers; ++s) {
+        if (acc.value[s][0] > 0) {
+            score_node_hit<R>(acc.node,
+                              s,
+                              *acc.geo,
+                              acc.cnb,
+                              acc.spot_ind,
+                              acc.value[s],
+                              acc.n_values[s],
+                              acc.private_scoring,
+                              acc.scorer_base);
+        }
+    }
+    acc.node = nullptr;
+    acc.n_flushes++;
+}
+
+///< Score the deposit of the current step in voxel cnb into every scorer of the node.
+///< With an accumulator the hit values are held until the track changes voxel.
+template<typename R>
+CUDA_DEVICE inline void
+score_step(mqi::track_t<R>&                track,
+           mqi::grid3d<mqi::density_t, R>& c_geo,
+           mqi::cnb_t                      cnb,
+           uint32_t                        spot_ind,
+           mqi::scoring_buffer*            private_scoring,
+           uint32_t                        scorer_base,
+           deposit_accumulator_t<R>*       acc = nullptr) {
+    mqi::node_t<R>* node = track.c_node;
+    if (acc && node->n_scorers <= deposit_accumulator_t<R>::max_scorers) {
+        if (acc->node != node || acc->cnb != cnb || acc->spot_ind != spot_ind) {
+            flush_deposits<R>(*acc);
+            acc->node            = node;
+            acc->geo             = &c_geo;
+            acc->cnb             = cnb;
+            acc->spot_ind        = spot_ind;
+            acc->private_scoring = private_scoring;
+            acc->scorer_base     = scorer_base;
+            for (uint8_t s = 0; s < node->n_scorers; ++s) {
+                acc->n_values[s] = node->scorers[s]->n_quantities_;
+                acc->value[s][0] = (node->scorers[s]->roi_->idx(cnb) > 0) ? 0.0 : -1.0;
+                for (uint8_t q = 1; q < acc->n_values[s]; ++q)
+                    acc->value[s][q] = 0.0;
+            }
+        }
+        for (uint8_t s = 0; s < node->n_scorers; ++s) {
+            if (acc->value[s][0] < 0) continue;
+            double        v[mqi::scorer<R>::max_quantities];
+            const uint8_t n = mqi::compute_hits<R>(*node->scorers[s], track, cnb, c_geo, v);
+            ///< a table ignores hits <= 0, so they are not summed either
+            if (v[0] <= 0) continue;
+            for (uint8_t q = 0; q < n; ++q)
+                acc->value[s][q] += v[q];
+        }
+        acc->n_steps++;
+        return;
+    }
+    for (uint8_t s = 0; s < node->n_scorers; ++s) {
+        if (node->scorers[s]->roi_->idx(cnb) > 0) {
+            double        v[mqi::scorer<R>::max_quantities];
+            const uint8_t n = mqi::compute_hits<R>(*node->scorers[s], track, cnb, c_geo, v);
+            score_node_hit<R>(node, s, c_geo, cnb, spot_ind, v, n, private_scoring, scorer_base);
+        }
+    }
+}
+
+///< Maximum number of voxels a multi-voxel step is distributed over
+constexpr uint16_t step_max_voxels = 64;
+
+///< Voxels crossed from the pre-step point of the track along its pre-step
+///< direction over length, with the path length in each (cnbs, lens).
+///< Stops at the node boundary or after step_max_voxels voxels.
+///< Returns the number of voxels; travelled is the sum of lens.
+template<typename R>
+CUDA_DEVICE inline uint16_t
+trace_voxels(mqi::track_t<R>&                track,
+             mqi::grid3d<mqi::density_t, R>& c_geo,
+             mqi::dda_t<R>&                  dda,
+             const R                         length,
+             mqi::cnb_t*                     cnbs,
+             R*                              lens,
+             R&                              travelled) {
+    uint16_t              n_voxels = 0;
+    mqi::vec3<R>          pos      = track.vtx0.pos;
+    mqi::vec3<mqi::ijk_t> cell     = track.its.cell;
+    travelled                      = 0;
+    while (true) {
+        mqi::intersect_t<R> its = c_geo.intersect(pos, track.vtx0.dir, cell, dda);
+        R                   seg = (its.dist > 0) ? its.dist : 0;
+        if (travelled + seg > length) seg = length - travelled;
+        cnbs[n_voxels] = c_geo.ijk2cnb(cell);
+        lens[n_voxels] = seg;
+        travelled += seg;
+        ++n_voxels;
+        if (travelled >= length || its.dist <= 0) break;
+        pos = track.vtx0.pos + track.vtx0.dir * travelled;
+        c_geo.index(pos, track.vtx0.dir, cell);
+        if (!c_geo.is_valid(cell) || n_voxels == step_max_voxels) break;
+    }
+    return n_voxels;
+}
+
+///< Score the deposit of a step that crossed n_voxels voxels. The continuous
+///< loss (track.dE) is shared in proportion to weights up to a total weight of
+///< moved; the local deposit goes to the voxel where the step ends.
+///< Each voxel is scored with the segment of the step inside it (lens are the
+///< path lengths from trace_voxels) so that track length and LET scorers see
+///< the length of that segment; the last one ends at the post-step point.
+template<typename R>
+CUDA_DEVICE inline void
+score_along_step(mqi::track_t<R>&                track,
+                 mqi::grid3d<mqi::density_t, R>& c_geo,
+                 const mqi::cnb_t*               cnbs,
+                 const R*                        lens,
+                 const R*                        weights,
+                 uint16_t                        n_voxels,
+                 R                               moved,
+                 uint32_t                        spot_ind,
+                 mqi::scoring_buffer*            private_scoring,
+                 uint32_t                        scorer_base,
+                 deposit_accumulator_t<R>*       acc) {
+    const R            dE       = track.dE;
+    const R            local_dE = track.local_dE;
+    const mqi::vec3<R> pos0     = track.vtx0.pos;
+    const mqi::vec3<R> pos1     = track.vtx1.pos;
+    R                  cum      = 0;
+    R                  path     = 0;   ///< distance of the segment end from pos0
+    for (uint16_t v = 0; v < n_voxels; ++v) {
+        R share = moved - cum;
+        if (share > weights[v]) share = weights[v];
+        cum += weights[v];
+        const bool last = (cum >= moved) || (v + 1 == n_voxels);
+        track.dE        = (moved > 0) ? dE * share / moved : ((v == 0) ? dE : 0);
+        track.local_dE  = last ? local_dE : 0;
+        path += (weights[v] > 0) ? lens[v] * (share / weights[v]) : lens[v];
+        track.vtx1.pos = last ? pos1 : pos0 + track.vtx0.dir * path;
+        score_step<R>(track, c_geo, cnbs[v], spot_ind, private_scoring, scorer_base, acc);
+        if (last) break;
+        track.vtx0.pos = track.vtx1.pos;
+    }
+    track.vtx0.pos = pos0;
+    track.vtx1.pos = pos1;
+    track.dE       = dE;
+    track.local_dE = local_dE;
+}
+
+///< One Woodcock tracking step from the current cell of the track.
+///< The step is sampled against the majorant density of the block of the cell
+///< (of the node if the grid has no majorant blocks), stops at the block faces
+///< and may cross several voxels. Its continuous energy loss is shared among them in proportion
+///< to their water-equivalent lengths; deposits of an interaction are scored
+///< where the step ends. Returns false (nothing done) if the step has no length.
+template<typename R>
+CUDA_DEVICE bool
+woodcock_step(mqi::track_t<R>&                track,
+              mqi::track_stack_t<R>&          stack,
+              mqi::mqi_rng*                   thread_rng,
+              mqi::fippel_physics<R>&         fippel,
+              mqi::grid3d<mqi::density_t, R>& c_geo,
+              mqi::dda_t<R>&                  dda,
+              uint32_t                        spot_ind,
+              bool                            score_local_deposit,
+              mqi::scoring_buffer*            private_scoring,
+              uint32_t                        scorer_base,
+              deposit_accumulator_t<R>*       acc) {
+    mqi::h2o_t<R> mat;
+    R             limit = c_geo.distance_to_exit(track.vtx0.pos, track.vtx0.dir);
+    mat.rho_mass        = c_geo.majorant(track.its.cell);
+    if (mat.rho_mass < 0) {
+        mat.rho_mass = track.c_node->majorant_density;
+    } else {
+        ///< on a block face: leave it with a voxel step
+        const R to_block = c_geo.majorant_distance(track.vtx0.pos, track.vtx0.dir, track.its.cell);
+        if (!(to_block > mqi::geometry_tolerance)) return false;
+        if (to_block < limit) limit = to_block;
+    }
+    R    cs_max[4];
+    bool interaction;
+    R    length = fippel.woodcock_length(track, thread_rng, mat, limit, cs_max, interaction);
+    if (!(length > 0)) return false;
+
+    ///< voxels crossed by the step, their path and water-equivalent lengths
+    mqi::cnb_t     cnbs[step_max_voxels];
+    R              lens[step_max_voxels];
+    R              wel[step_max_voxels];
+    R              travelled;
+    const uint16_t n_voxels = trace_voxels<R>(track, c_geo, dda, length, cnbs, lens, travelled);
+    if (travelled < length) {
+        ///< cut short by the node boundary or the voxel limit: no interaction
+        length      = travelled;
+        interaction = false;
+    }
+    if (!(length > 0)) return false;
+    R wel_sum = 0;
+    for (uint16_t v = 0; v < n_voxels; ++v) {
+        mat.rho_mass = c_geo[cnbs[v]];
+        wel[v]       = lens[v] * mat.stopping_power_ratio(track.vtx0.ke) * mat.rho_mass /
+                       fippel.units.water_density;
+        wel_sum += wel[v];
+    }
+
+    ///< mat holds the density at the end point
+    const R moved = fippel.woodcock_stepping(
+      track, stack, thread_rng, length, wel_sum, interaction, cs_max, mat, score_local_deposit);
+    score_along_step<R>(track,
+                        c_geo,
+                        cnbs,
+                        lens,
+                        wel,
+                        n_voxels,
+                        moved,
+                        spot_ind,
+                        private_scoring,
+                        scorer_base,
+                        acc);
+
+    if (!track.is_stopped()) {
+        track.its.cell = c_geo.index(track.vtx1.pos, track.vtx1.dir);
+        track.move();
+    }
+    return true;
+}
+
+///< One step inside a homogeneous super-voxel: the physics step is limited by
+///< the faces of the block instead of the voxel, and its deposit is shared among
+///< the voxels crossed in proportion to their path lengths.
+template<typename R>
+CUDA_DEVICE void
+super_voxel_step(mqi::track_t<R>&                track,
+                 mqi::track_stack_t<R>&          stack,
+                 mqi::mqi_rng*                   thread_rng,
+                 mqi::fippel_physics<R>&         fippel,
+                 mqi::grid3d<mqi::density_t, R>& c_geo,
+                 mqi::dda_t<R>&                  dda,
+                 mqi::h2o_t<R>&                  water,
+                 const R                         block_distance,
+                 uint32_t                        spot_ind,
+                 bool                            score_local_deposit,
+                 mqi::scoring_buffer*            private_scoring,
+                 uint32_t                        scorer_base,
+                 deposit_accumulator_t<R>*       acc) {
+    fippel.stepping(
+      track, stack, thread_rng, water.rho_mass, water, block_distance, score_local_deposit);
+    const R        length = (track.vtx1.pos - track.vtx0.pos).norm();
+    mqi::cnb_t     cnbs[step_max_voxels];
+    R              lens[step_max_voxels];
+    R              travelled;
+    const uint16_t n_voxels = trace_voxels<R>(track, c_geo, dda, length, cnbs, lens, travelled);
+    ///< a remainder beyond step_max_voxels voxels stays with the last one
+    lens[n_voxels - 1] += length - travelled;
+    score_along_step<R>(track,
+                        c_geo,
+                        cnbs,
+                        lens,
+                        lens,
+                        n_voxels,
+                        length,
+                        spot_ind,
+                        private_scoring,
+                        scorer_base,
+                        acc);
+
+    if (!track.is_stopped()) {
+        track.its.cell = c_geo.index(track.vtx1.pos, track.vtx1.dir);
+        track.move();
+    }
+}
+
+///< Transports the histories [h_begin, h_end) with the given random number generator.
+///< Shared by the static (start_and_length) and the scheduled CPU dispatch.
+///< private_scoring: one buffer per scorer (scorer_base_index order) that takes the
+///< deposits instead of the shared scorer tables (CPU only).
+///< spill: overflow buffer of the track stack of this thread (CUDA only).
+template<typename R>
+CUDA_DEVICE void
+transport_histories(mqi::mqi_rng*               thread_rng,
+                    mqi::node_t<R>*             world,
+                    mqi::vertex_t<R>*           vertices,
+                    const uint32_t              h_begin,
+                    const uint32_t              h_end,
+                    uint32_t*                   tracked_particles,
+                    uint32_t*                   scorer_offset_vector = nullptr,
+                    bool                        score_local_deposit  = true,
+                    mqi::scoring_buffer*        private_scoring      = nullptr,
+                    mqi::track_stack_spill_t<R> spill                = {}) {
     mqi::fippel_physics<R>    fippel;
     mqi::h2o_t<R>             water;   // 1e-3 g/mm^3
     uint32_t                  spot_ind;
     uint32_t                  c_ind;
     mqi::vec3<mqi::ijk_t>     index_checker;
-    mqi::intersect_t<R>       its;
-    mqi::dL_t<R>              Lmin;
     mqi::cnb_t                cnb;             //< child number
-    uint8_t                   nb_of_scorers;   //< scorer number
+    uint32_t                  scorer_base = 0;   //< first private buffer of a child
     R                         rho_mass = 1e-3;
+    mqi::track_stack_t<R>     stack;   ///< emptied by every history, its storage is reused
+    deposit_accumulator_t<R>  deposits;   ///< scored when the track leaves a voxel
+    mqi::dda_t<R>             dda;        ///< voxel traversal of the track in c_geo
+#if defined(__CUDACC__)
+    stack.set_overflow_buffer(spill.buffer, spill.capacity);
+#else
+    (void) spill;   ///< CPU stacks grow on the heap instead of spilling
+#endif
     ///< count for physics process rates
-    for (uint32_t i = h_range.x; i < h_range.x + h_range.y; ++i) {
+    for (uint32_t i = h_begin; i < h_end; ++i) {
         if (scorer_offset_vector) {
             spot_ind = scorer_offset_vector[i];
         } else {
             spot_ind = mqi::empty_pair;
         }
-        mqi::track_t<R>       primary(vertices[i]);
-        mqi::track_stack_t<R> stack;
+#if !defined(__CUDACC__)
+        ///< the numbers of a history depend on its identity, not on the calling thread
+        thread_rng->stream(spot_ind, thread_rng->history_offset + i);
+#endif
+        mqi::track_t<R> primary(vertices[i]);
         stack.push_secondary(primary);
 
         ///< do until stacked track is empty
         while (!stack.is_empty()) {
-            mqi::track_t<R> track = stack.pop();   // pop a particle
+            ///< transported in place; its secondaries are pushed above it
+            const uint32_t   slot  = stack.idx - 1;
+            mqi::track_t<R>& track = stack.top();
             for (c_ind = 0; c_ind < world->n_children; c_ind++) {
                 mqi::grid3d<mqi::density_t, R>& c_geo = *(world->children[c_ind]->geo);
                 track.c_node                          = world->children[c_ind];
-                nb_of_scorers                         = track.c_node->n_scorers;
+                if (private_scoring) scorer_base = scorer_base_index(world, c_ind);
                 //                track.vtx0.pos =c_geo.rotation_matrix_inv * (track.vtx0.pos - c_geo.translation_vector) +c_geo.translation_vector;   // rotate the vertex
                 //                track.vtx0.dir =c_geo.rotation_matrix_inv * (track.vtx0.dir);   // rotate the vertex
                 track.vtx0.pos =
@@ -167,12 +644,48 @@ transport_particles_patient(mqi::thrd_t*      threads,
                     track.its.dist = 0.0;
                     track.its.cell = index_checker;
                 }
+                dda.valid = false;
                 while (c_geo.is_valid(track.its.cell) && !track.is_stopped()) {
+                    if (track.c_node->majorant_density > 0 && track.vtx0.ke >= fippel.Tp_cut &&
+                        woodcock_step<R>(track,
+                                         stack,
+                                         thread_rng,
+                                         fippel,
+                                         c_geo,
+                                         dda,
+                                         spot_ind,
+                                         score_local_deposit,
+                                         private_scoring,
+                                         scorer_base,
+                                         &deposits)) {
+                        continue;
+                    }
                     cnb       = c_geo.ijk2cnb(track.its.cell);
-                    track.its = c_geo.intersect(track.vtx0.pos, track.vtx0.dir, track.its.cell);
+                    track.its = c_geo.intersect(
+                      track.vtx0.pos, track.vtx0.dir, track.its.cell, dda);
                     rho_mass  = c_geo[cnb];
 
                     water.rho_mass = rho_mass;
+                    if (track.its.dist > 0) {
+                        const R block_distance = c_geo.super_voxel_distance(
+                          track.vtx0.pos, track.vtx0.dir, track.its.cell);
+                        if (block_distance > track.its.dist) {
+                            super_voxel_step<R>(track,
+                                                stack,
+                                                thread_rng,
+                                                fippel,
+                                                c_geo,
+                                                dda,
+                                                water,
+                                                block_distance,
+                                                spot_ind,
+                                                score_local_deposit,
+                                                private_scoring,
+                                                scorer_base,
+                                                &deposits);
+                            continue;
+                        }
+                    }
 #ifdef __PHYSICS_DEBUG__
                     if (!track.primary && track.dE > 0) {
                         track.stop();
@@ -195,17 +708,8 @@ transport_particles_patient(mqi::thrd_t*      threads,
                                     score_local_deposit);
 #endif
                     if (track.its.dist < 0) break;
-                    for (uint8_t s = 0; s < nb_of_scorers; ++s) {
-                        if (track.c_node->scorers[s]->roi_->idx(cnb) > 0) {
-                            insert_hashtable<R>(
-                              track.c_node->scorers[s]->data_,
-                              cnb,
-                              spot_ind,
-                              track.c_node->scorers[s]->compute_hit_(track, cnb, c_geo),
-                              c_geo.get_nxyz().x * c_geo.get_nxyz().y * c_geo.get_nxyz().z,
-                              track.c_node->scorers[s]->max_capacity_);
-                        }
-                    }
+                    score_step<R>(
+                      track, c_geo, cnb, spot_ind, private_scoring, scorer_base, &deposits);
 
                     if (!track.is_stopped()) {
                         c_geo.index(track.vtx1.pos,
@@ -214,6 +718,7 @@ transport_particles_patient(mqi::thrd_t*      threads,
                         track.move();
                     }
                 }
+                flush_deposits<R>(deposits);
                 //                track.vtx0.pos = c_geo.rotation_matrix_fwd * (track.vtx0.pos - c_geo.translation_vector) + c_geo.translation_vector;
                 //                track.vtx0.dir = c_geo.rotation_matrix_fwd * (track.vtx0.dir);   // rotate the vertex
                 track.vtx0.pos =
@@ -222,14 +727,53 @@ transport_particles_patient(mqi::thrd_t*      threads,
                 track.vtx1.pos = track.vtx0.pos;
                 track.vtx1.dir = track.vtx0.dir;
             }   //while(history is out-of-world or zero energy
-
+            stack.remove(slot);
         }   //while(stack is not empty)
 #if defined(__CUDACC__)
         atomicAdd(tracked_particles, 1);
 #else
-        tracked_particles[0] += 1;
+        __atomic_fetch_add(tracked_particles, 1, __ATOMIC_RELAXED);
 #endif
     }   //for
+#if defined(__CUDACC__)
+    if (spill.counters && stack.n_overflow > 0) {
+        atomicAdd(&spill.counters[0], stack.n_overflow);
+        atomicAdd(&spill.counters[1], stack.n_dropped);
+    }
+#endif
+}   //transport_histories
+
+template<typename R>
+CUDA_GLOBAL void
+transport_particles_patient(mqi::thrd_t*                threads,
+                            mqi::node_t<R>*             world,
+                            mqi::vertex_t<R>*           vertices,
+                            const uint32_t              n_vtx,
+                            uint32_t*                   tracked_particles,
+                            uint32_t*                   scorer_offset_vector = nullptr,
+                            bool                        score_local_deposit  = true,
+                            uint32_t                    total_threads        = 1,   // # of CPU threads
+                            uint32_t                    thread_id            = 0,   // CPU thread-id
+                            mqi::track_stack_spill_t<R> spill                = {})
+{
+
+#if defined(__CUDACC__)
+    ///< Thread id and total number of threads are replaced in CUDA
+    thread_id     = blockIdx.x * blockDim.x + threadIdx.x;
+    total_threads = (blockDim.x * gridDim.x);
+#endif
+
+    const mqi::vec2<uint32_t> h_range = mqi::start_and_length(total_threads, n_vtx, thread_id);
+    transport_histories<R>(&threads[thread_id].rnd_generator,
+                           world,
+                           vertices,
+                           h_range.x,
+                           h_range.x + h_range.y,
+                           tracked_particles,
+                           scorer_offset_vector,
+                           score_local_deposit,
+                           nullptr,
+                           spill.of_thread(thread_id));
 }   //transport_particles_table
 
 template<typename R>
@@ -266,6 +810,8 @@ transport_particles_patient_seed(mqi::thrd_t*      threads,
     mqi::cnb_t                cnb;             //< child number
     uint8_t                   nb_of_scorers;   //< scorer number
     R                         rho_mass = 1e-3;
+    mqi::track_stack_t<R>     stack;   ///< emptied by every history, its storage is reused
+    mqi::dda_t<R>             dda;     ///< voxel traversal of the track in c_geo
 
     ///< count for physics process rates
     for (uint32_t i = h_range.x; i < h_range.x + h_range.y; ++i) {
@@ -277,12 +823,13 @@ transport_particles_patient_seed(mqi::thrd_t*      threads,
         } else {
             spot_ind = mqi::empty_pair;
         }
-        mqi::track_t<R>       primary(vertices[i]);
-        mqi::track_stack_t<R> stack;
+        mqi::track_t<R> primary(vertices[i]);
         stack.push_secondary(primary);
         ///< do until stacked track is empty
         while (!stack.is_empty()) {
-            mqi::track_t<R> track = stack.pop();   // pop a particle
+            ///< transported in place; its secondaries are pushed above it
+            const uint32_t   slot  = stack.idx - 1;
+            mqi::track_t<R>& track = stack.top();
             for (c_ind = 0; c_ind < world->n_children; c_ind++) {
                 mqi::grid3d<mqi::density_t, R>& c_geo = *(world->children[c_ind]->geo);
                 track.c_node                          = world->children[c_ind];
@@ -321,9 +868,11 @@ transport_particles_patient_seed(mqi::thrd_t*      threads,
                     track.its.cell = index_checker;
                 }
 
+                dda.valid = false;
                 while (c_geo.is_valid(track.its.cell) && !track.is_stopped()) {
                     cnb       = c_geo.ijk2cnb(track.its.cell);
-                    track.its = c_geo.intersect(track.vtx0.pos, track.vtx0.dir, track.its.cell);
+                    track.its = c_geo.intersect(
+                      track.vtx0.pos, track.vtx0.dir, track.its.cell, dda);
                     rho_mass  = c_geo[cnb];
                     water.rho_mass = rho_mass;
 #ifdef __PHYSICS_DEBUG__
@@ -350,13 +899,16 @@ transport_particles_patient_seed(mqi::thrd_t*      threads,
                     if (track.its.dist < 0) break;
                     for (uint8_t s = 0; s < nb_of_scorers; ++s) {
                         if (track.c_node->scorers[s]->roi_->idx(cnb) > 0) {
-                            insert_hashtable<R>(
-                              track.c_node->scorers[s]->data_,
+                            double        v[mqi::scorer<R>::max_quantities];
+                            const uint8_t n = mqi::compute_hits<R>(
+                              *track.c_node->scorers[s], track, cnb, c_geo, v);
+                            score_hits<R>(
+                              track.c_node->scorers[s],
                               cnb,
                               spot_ind,
-                              track.c_node->scorers[s]->compute_hit_(track, cnb, c_geo),
-                              c_geo.get_nxyz().x * c_geo.get_nxyz().y * c_geo.get_nxyz().z,
-                              track.c_node->scorers[s]->max_capacity_);
+                              v,
+                              n,
+                              c_geo.get_nxyz().x * c_geo.get_nxyz().y * c_geo.get_nxyz().z);
                         }
                     }
 
@@ -376,13 +928,13 @@ transport_particles_patient_seed(mqi::thrd_t*      threads,
                 track.vtx1.pos = track.vtx0.pos;
                 track.vtx1.dir = track.vtx0.dir;
             }   //while(history is out-of-world or zero energy
-
+            stack.remove(slot);
         }   //while(stack is not empty)
 
 #if defined(__CUDACC__)
         atomicAdd(tracked_particles, 1);
 #else
-        tracked_particles[0] += 1;
+        __atomic_fetch_add(tracked_particles, 1, __ATOMIC_RELAXED);
 #endif
     }   //for
 }   //transport_particles_table
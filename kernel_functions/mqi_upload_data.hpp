@@ -64,15 +64,19 @@ void
 upload_beamsource(mqi::beamsource<R> src, mqi::beamsource<R>*& dest) {
     gpu_err_chk(cudaMalloc(&dest, sizeof(mqi::beamsource<R>)));
     gpu_err_chk(cudaMemcpy(dest, &src, sizeof(mqi::beamsource<R>), cudaMemcpyHostToDevice));
-    size_t* d_cdf;
-    size_t* d_beamlet;
-    gpu_err_chk(cudaMalloc(&d_cdf, src.beamlet_size_ * sizeof(size_t)));
-    gpu_err_chk(cudaMemcpy(
-      d_cdf, src.array_cdf_, src.beamlet_size_ * sizeof(size_t), cudaMemcpyHostToDevice));
-    gpu_err_chk(cudaMalloc(&d_beamlet, src.beamlet_size_ * sizeof(size_t)));
+    size_t*             d_cdf;
+    size_t*             d_beamlet;
+    const size_t        n_beamlets = src.cdf_.size();
+    std::vector<size_t> beamlet_ids(n_beamlets);
+    for (size_t i = 0; i < n_beamlets; i++)
+        beamlet_ids[i] = i;
+    gpu_err_chk(cudaMalloc(&d_cdf, n_beamlets * sizeof(size_t)));
+    gpu_err_chk(
+      cudaMemcpy(d_cdf, src.cdf_.data(), n_beamlets * sizeof(size_t), cudaMemcpyHostToDevice));
+    gpu_err_chk(cudaMalloc(&d_beamlet, n_beamlets * sizeof(size_t)));
     gpu_err_chk(cudaMemcpy(
-      d_beamlet, src.array_beamlet_, src.beamlet_size_ * sizeof(size_t), cudaMemcpyHostToDevice));
-    add_beamlet<R><<<1, 1>>>(dest, d_cdf, d_beamlet, src.beamlet_size_);
+      d_beamlet, beamlet_ids.data(), n_beamlets * sizeof(size_t), cudaMemcpyHostToDevice));
+    add_beamlet<R><<<1, 1>>>(dest, d_cdf, d_beamlet, n_beamlets);
     mqi::check_cuda_last_error("(add beamlet)");
     //    for (int i = 0; i < src.beamlet_size_; i++) {
     //        printf("cdf cpu %d %d %d\n", i, src.array_cdf_[i], src.array_beamlet_[i]);
@@ -126,12 +130,15 @@ add_node_scorers(mqi::node_t<R>*         node,
                  uint32_t*               scorer_sizes        = nullptr,
                  std::string*            scorer_names        = nullptr,
                  mqi::fp_compute_hit<R>* fp                  = nullptr,
+                 mqi::hit_t*             hits                = nullptr,
                  mqi::roi_mapping_t*     roi_method          = nullptr,
                  uint32_t*               roi_original_length = nullptr,
                  uint32_t*               roi_length          = nullptr,
                  uint32_t**              roi_start           = nullptr,
                  uint32_t**              roi_stride          = nullptr,
-                 uint32_t**              roi_acc_stride      = nullptr) {
+                 uint32_t**              roi_acc_stride      = nullptr,
+                 uint32_t**              roi_bitmap          = nullptr,
+                 uint32_t**              roi_rank            = nullptr) {
 
     //std::cout << "Adding scorers node .. : Node --> " << node << ", number of children --> " << n_scorers << std::endl;
 
@@ -147,7 +154,7 @@ add_node_scorers(mqi::node_t<R>*         node,
 
     for (int i = 0; i < n_scorers; i++) {
         //printf("scorer size[%d] %d\n", i, scorer_sizes[i]);
-        node->scorers[i] = new mqi::scorer<R>("", scorer_sizes[i], fp[i]);
+        node->scorers[i] = new mqi::scorer<R>("", scorer_sizes[i], fp[i], hits[i]);
         //printf("compute hit %p\n", node->scorers[i]->compute_hit_);
 
         if (scorers_count) {
@@ -164,6 +171,10 @@ add_node_scorers(mqi::node_t<R>*         node,
                                                 roi_start[i],
                                                 roi_stride[i],
                                                 roi_acc_stride[i]);
+        if (roi_bitmap) {
+            node->scorers[i]->roi_->bitmap_ = roi_bitmap[i];
+            node->scorers[i]->roi_->rank_   = roi_rank[i];
+        }
         //        printf("scorer[i] mask %p\n", node->scorers[i]->roi_mask_);
         if (scorers_count) {
             node->scorers[i]->count_    = scorers_count[i];
@@ -246,6 +257,8 @@ upload_node(mqi::node_t<R>* c_node, mqi::node_t<R>*& g_node) {
     uint32_t**          h_roi_start         = nullptr;
     uint32_t**          h_roi_stride        = nullptr;
     uint32_t**          h_roi_acc_stride    = nullptr;
+    uint32_t**          h_roi_bitmap        = nullptr;
+    uint32_t**          h_roi_rank          = nullptr;
     uint32_t*           roi_length          = nullptr;
     uint32_t*           roi_original_length = nullptr;
     mqi::roi_mapping_t* roi_method          = nullptr;
@@ -253,6 +266,8 @@ upload_node(mqi::node_t<R>* c_node, mqi::node_t<R>*& g_node) {
     uint32_t**          d_roi_start           = nullptr;
     uint32_t**          d_roi_stride          = nullptr;
     uint32_t**          d_roi_acc_stride      = nullptr;
+    uint32_t**          d_roi_bitmap          = nullptr;
+    uint32_t**          d_roi_rank            = nullptr;
     uint32_t*           d_roi_length          = nullptr;
     uint32_t*           d_roi_original_length = nullptr;
     mqi::roi_mapping_t* d_roi_method          = nullptr;
@@ -263,6 +278,9 @@ upload_node(mqi::node_t<R>* c_node, mqi::node_t<R>*& g_node) {
     mqi::fp_compute_hit<R>* fp   = nullptr;
     mqi::fp_compute_hit<R>* d_fp = nullptr;
 
+    mqi::hit_t* hits   = nullptr;
+    mqi::hit_t* d_hits = nullptr;
+
     std::string* scorers_name   = nullptr;
     std::string* d_scorers_name = nullptr;
     if (c_node->n_scorers > 0) {
@@ -271,9 +289,12 @@ upload_node(mqi::node_t<R>* c_node, mqi::node_t<R>*& g_node) {
         scorers_size        = new uint32_t[c_node->n_scorers];
         scorers_name        = new std::string[c_node->n_scorers];
         fp                  = new mqi::fp_compute_hit<R>[c_node->n_scorers];
+        hits                = new mqi::hit_t[c_node->n_scorers];
         h_roi_start         = new uint32_t*[c_node->n_scorers];
         h_roi_stride        = new uint32_t*[c_node->n_scorers];
         h_roi_acc_stride    = new uint32_t*[c_node->n_scorers];
+        h_roi_bitmap        = new uint32_t*[c_node->n_scorers];
+        h_roi_rank          = new uint32_t*[c_node->n_scorers];
         roi_length          = new uint32_t[c_node->n_scorers];
         roi_original_length = new uint32_t[c_node->n_scorers];
         roi_method          = new mqi::roi_mapping_t[c_node->n_scorers];
@@ -282,9 +303,12 @@ upload_node(mqi::node_t<R>* c_node, mqi::node_t<R>*& g_node) {
         gpu_err_chk(cudaMalloc(&d_scorers_size, c_node->n_scorers * sizeof(uint32_t)));
         gpu_err_chk(cudaMalloc(&d_scorers_data, c_node->n_scorers * sizeof(mqi::key_value*)));
         gpu_err_chk(cudaMalloc(&d_fp, c_node->n_scorers * sizeof(mqi::fp_compute_hit<R>)));
+        gpu_err_chk(cudaMalloc(&d_hits, c_node->n_scorers * sizeof(mqi::hit_t)));
         gpu_err_chk(cudaMalloc(&d_roi_start, c_node->n_scorers * sizeof(uint32_t*)));
         gpu_err_chk(cudaMalloc(&d_roi_stride, c_node->n_scorers * sizeof(uint32_t*)));
         gpu_err_chk(cudaMalloc(&d_roi_acc_stride, c_node->n_scorers * sizeof(uint32_t*)));
+        gpu_err_chk(cudaMalloc(&d_roi_bitmap, c_node->n_scorers * sizeof(uint32_t*)));
+        gpu_err_chk(cudaMalloc(&d_roi_rank, c_node->n_scorers * sizeof(uint32_t*)));
         gpu_err_chk(cudaMalloc(&d_roi_length, c_node->n_scorers * sizeof(uint32_t)));
         gpu_err_chk(cudaMalloc(&d_roi_original_length, c_node->n_scorers * sizeof(uint32_t)));
         gpu_err_chk(cudaMalloc(&d_roi_method, c_node->n_scorers * sizeof(mqi::roi_mapping_t)));
@@ -338,6 +362,21 @@ upload_node(mqi::node_t<R>* c_node, mqi::node_t<R>*& g_node) {
                 h_roi_stride[i]     = nullptr;
                 h_roi_acc_stride[i] = nullptr;
             }
+            h_roi_bitmap[i] = nullptr;
+            h_roi_rank[i]   = nullptr;
+            if (c_node->scorers[i]->roi_->bitmap_ != nullptr) {
+                const size_t n_words = c_node->scorers[i]->roi_->n_bitmap_words();
+                gpu_err_chk(cudaMalloc(&h_roi_bitmap[i], n_words * sizeof(uint32_t)));
+                gpu_err_chk(cudaMalloc(&h_roi_rank[i], n_words * sizeof(uint32_t)));
+                gpu_err_chk(cudaMemcpy(h_roi_bitmap[i],
+                                       c_node->scorers[i]->roi_->bitmap_,
+                                       n_words * sizeof(uint32_t),
+                                       cudaMemcpyHostToDevice));
+                gpu_err_chk(cudaMemcpy(h_roi_rank[i],
+                                       c_node->scorers[i]->roi_->rank_,
+                                       n_words * sizeof(uint32_t),
+                                       cudaMemcpyHostToDevice));
+            }
             if (c_node->scorers[i]->score_variance_) {
                 gpu_err_chk(cudaMalloc(&h_scorers_count[i],
                                        c_node->scorers[i]->max_capacity_ * sizeof(mqi::key_value)));
@@ -381,6 +420,7 @@ upload_node(mqi::node_t<R>* c_node, mqi::node_t<R>*& g_node) {
             scorers_size[i]        = c_node->scorers[i]->max_capacity_;
             scorers_name[i]        = c_node->scorers[i]->name_;
             fp[i]                  = c_node->scorers[i]->compute_hit_;
+            hits[i]                = c_node->scorers[i]->hit_;
             roi_method[i]          = c_node->scorers[i]->roi_->method_;
             roi_original_length[i] = c_node->scorers[i]->roi_->original_length_;
             roi_length[i]          = c_node->scorers[i]->roi_->length_;
@@ -400,6 +440,12 @@ upload_node(mqi::node_t<R>* c_node, mqi::node_t<R>*& g_node) {
                                h_roi_acc_stride,
                                c_node->n_scorers * sizeof(uint32_t*),
                                cudaMemcpyHostToDevice));
+        gpu_err_chk(cudaMemcpy(d_roi_bitmap,
+                               h_roi_bitmap,
+                               c_node->n_scorers * sizeof(uint32_t*),
+                               cudaMemcpyHostToDevice));
+        gpu_err_chk(cudaMemcpy(
+          d_roi_rank, h_roi_rank, c_node->n_scorers * sizeof(uint32_t*), cudaMemcpyHostToDevice));
         if (h_scorers_count) {
             gpu_err_chk(cudaMemcpy(d_scorers_count,
                                    h_scorers_count,
@@ -426,6 +472,8 @@ upload_node(mqi::node_t<R>* c_node, mqi::node_t<R>*& g_node) {
                                cudaMemcpyHostToDevice));
         gpu_err_chk(cudaMemcpy(
           d_fp, fp, c_node->n_scorers * sizeof(mqi::fp_compute_hit<R>), cudaMemcpyHostToDevice));
+        gpu_err_chk(cudaMemcpy(
+          d_hits, hits, c_node->n_scorers * sizeof(mqi::hit_t), cudaMemcpyHostToDevice));
         gpu_err_chk(cudaMemcpy(
           d_roi_length, roi_length, c_node->n_scorers * sizeof(uint32_t), cudaMemcpyHostToDevice));
         gpu_err_chk(cudaMemcpy(d_roi_original_length,
@@ -489,12 +537,15 @@ upload_node(mqi::node_t<R>* c_node, mqi::node_t<R>*& g_node) {
                                           d_scorers_size,
                                           d_scorers_name,
                                           d_fp,
+                                          d_hits,
                                           d_roi_method,
                                           d_roi_original_length,
                                           d_roi_length,
                                           d_roi_start,
                                           d_roi_stride,
-                                          d_roi_acc_stride);
+                                          d_roi_acc_stride,
+                                          d_roi_bitmap,
+                                          d_roi_rank);
     } else {
         mc::add_node_scorers<R><<<1, 1>>>(g_node);
     }
@@ -513,15 +564,21 @@ upload_node(mqi::node_t<R>* c_node, mqi::node_t<R>*& g_node) {
     delete[] h_children;
     delete[] scorers_types;
     delete[] scorers_size;
+    delete[] hits;
+    delete[] h_roi_bitmap;
+    delete[] h_roi_rank;
 
     gpu_err_chk(cudaFree(d_scorers_types));   // it's working, but not sure it is required
     gpu_err_chk(cudaFree(d_scorers_size));    // it's working, but not sure it is required
+    gpu_err_chk(cudaFree(d_hits));
     gpu_err_chk(cudaFree(d_roi_method));
     gpu_err_chk(cudaFree(d_roi_original_length));
     gpu_err_chk(cudaFree(d_roi_length));
     gpu_err_chk(cudaFree(d_roi_start));
     gpu_err_chk(cudaFree(d_roi_stride));
     gpu_err_chk(cudaFree(d_roi_acc_stride));
+    gpu_err_chk(cudaFree(d_roi_bitmap));
+    gpu_err_chk(cudaFree(d_roi_rank));
     //    gpu_err_chk(cudaFree(d_roi));             // it's working, but not sure it is required
 }   //upload_node
 
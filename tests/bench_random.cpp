@@ -0,0 +1,50 @@
+// Micro-benchmark of the CPU normal and exponential samplers (not part of run_tests).
+// Usage: make bench && ./bench_random
+#include <moqui/base/mqi_math.hpp>
+#include <chrono>
+#include <cstdio>
+
+///< ns per number of sample() over n calls
+template<class Sample>
+double
+time_per_number(Sample sample, uint32_t n, double& checksum) {
+    auto start = std::chrono::high_resolution_clock::now();
+    for (uint32_t i = 0; i < n; ++i)
+        checksum += sample();
+    auto stop = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double, std::nano>(stop - start).count() / n;
+}
+
+int
+main() {
+    const uint32_t n = 20000000;
+    mqi::mqi_rng   rng(17);
+    double         checksum = 0;
+
+    ///< a std distribution per call, as mqi_normal and mqi_exponential did before
+    const double std_normal = time_per_number(
+      [&] {
+          std::normal_distribution<float> dist(0.0f, 1.0f);
+          return dist(rng);
+      },
+      n,
+      checksum);
+    const double zig_normal =
+      time_per_number([&] { return mqi::mqi_normal<float>(&rng, 0.0f, 1.0f); }, n, checksum);
+    const double std_exponential = time_per_number(
+      [&] {
+          std::exponential_distribution<float> dist(1.0f);
+          return dist(rng);
+      },
+      n,
+      checksum);
+    const double zig_exponential =
+      time_per_number([&] { return mqi::mqi_exponential<float>(&rng, 1.0f, 1e9f); }, n, checksum);
+
+    printf("normal:      std %.2f ns, ziggurat %.2f ns\n", std_normal, zig_normal);
+    printf("exponential: std %.2f ns, ziggurat %.2f ns (checksum %.3f)\n",
+           std_exponential,
+           zig_exponential,
+           checksum);
+    return 0;
+}
@@ -0,0 +1,65 @@
+// Micro-benchmark of one fippel_physics::stepping call (not part of run_tests).
+// Usage: make bench && ./bench_stepping
+#include <moqui/base/mqi_fippel_physics.hpp>
+#include <moqui/base/mqi_node.hpp>
+#include <chrono>
+#include <cstdio>
+
+int
+main() {
+    const uint32_t             n_steps = 2000000;
+    mqi::fippel_physics<float> fippel;
+    mqi::h2o_t<float>          mat;
+    mqi::mqi_rng               rng;
+    rng.seed(17);
+    const float densities[4] = { 1.0e-3f, 1.05e-3f, 0.35e-3f, 1.6e-3f };
+
+    ///< secondaries are placed in the frame of the track's node
+    mqi::grid3d<mqi::density_t, float> geo(-10.0f, 10.0f, 21, -10.0f, 10.0f, 21, -10.0f, 10.0f, 21);
+    mqi::node_t<float>                 node;
+    node.geo = &geo;
+
+    mqi::vertex_t<float> v;
+    v.pos = mqi::vec3<float>(0, 0, 0);
+    v.dir = mqi::vec3<float>(0, 0, 1);
+
+    mqi::track_stack_t<float> stk;
+    double                    checksum = 0;
+    auto                      start    = std::chrono::high_resolution_clock::now();
+    for (uint32_t i = 0; i < n_steps; ++i) {
+        v.ke = 5.0f + float(i % 200) + 0.001f * (i % 997);
+        mqi::track_t<float> trk(v);
+        trk.c_node = &node;
+        mat.rho_mass = densities[i % 4];
+        fippel.stepping(trk, stk, &rng, mat.rho_mass, mat, 2.0f, true);
+        checksum += trk.dE;
+        while (!stk.is_empty())
+            stk.pop();
+    }
+    auto stop = std::chrono::high_resolution_clock::now();
+
+    const double ns = std::chrono::duration<double, std::nano>(stop - start).count();
+    printf("stepping: %.1f ns/step over %u steps (checksum %.3f)\n", ns / n_steps, n_steps, checksum);
+
+    ///< a history's worth of secondaries through the stack, used in place as in transport
+    const uint32_t      n_tracks = 20000000;
+    mqi::track_t<float> trk(v);
+    start = std::chrono::high_resolution_clock::now();
+    for (uint32_t i = 0; i < n_tracks; i += 8) {
+        for (uint32_t s = 0; s < 8; ++s) {
+            trk.vtx0.ke = float(s);
+            stk.push_secondary(trk);
+        }
+        while (!stk.is_empty()) {
+            const mqi::track_t<float>& top = stk.top();
+            checksum += top.vtx0.ke;
+            stk.remove(stk.idx - 1);
+        }
+    }
+    stop = std::chrono::high_resolution_clock::now();
+    printf("track_t<float>: %zu bytes, %.2f ns per push and pop (checksum %.3f)\n",
+           sizeof(mqi::track_t<float>),
+           std::chrono::duration<double, std::nano>(stop - start).count() / n_tracks,
+           checksum);
+    return 0;
+}
@@ -0,0 +1,144 @@
+#include "test_framework.hpp"
+#include <moqui/base/mqi_beamsource.hpp>
+#include <vector>
+
+namespace
+{
+
+///< Beamsource of spots with energy e = spot id and the given histories.
+///< The distributions are kept in energies and fluences, reserved up front.
+mqi::beamsource<float>
+make_source(const std::vector<size_t>&         histories,
+            std::vector<mqi::const_1d<float>>& energies,
+            std::vector<mqi::phsp_6d<float>>&  fluences) {
+    mqi::beamsource<float> src;
+    std::array<float, 6>   mean = { 0, 0, 0, 0, 0, -1 };
+    std::array<float, 6>   sigm = { 1, 1, 0, 0.01, 0.01, 0 };
+    std::array<float, 2>   corr = { 0, 0 };
+    energies.reserve(histories.size());
+    fluences.reserve(histories.size());
+    for (size_t i = 0; i < histories.size(); ++i) {
+        energies.emplace_back(std::array<float, 1>{ float(i) }, std::array<float, 1>{ 0 });
+        fluences.emplace_back(mean, sigm, corr);
+        src.append_beamlet(mqi::beamlet<float>(&energies.back(), &fluences.back()), histories[i]);
+    }
+    return src;
+}
+
+}   // namespace
+
+// Test 1: The CDF lookup and the spot walk agree with a scan of the spots
+TEST(Beamsource_SpotRangesCoverHistories) {
+    const std::vector<size_t>         histories = { 3, 0, 5, 2, 0, 4 };
+    std::vector<mqi::const_1d<float>> energies;
+    std::vector<mqi::phsp_6d<float>>  fluences;
+    mqi::beamsource<float>            src = make_source(histories, energies, fluences);
+    ASSERT_EQ(src.total_histories(), size_t(14));
+
+    std::vector<size_t> spot_of;   ///< spot of each history by a scan
+    for (size_t i = 0; i < histories.size(); ++i)
+        spot_of.insert(spot_of.end(), histories[i], i);
+    for (size_t h = 0; h < spot_of.size(); ++h)
+        ASSERT_EQ(src.beamlet_id(h), spot_of[h]);
+
+    ///< batches that start and end inside spots
+    const size_t bounds[] = { 0, 2, 7, 8, 14 };
+    size_t       next     = 0;
+    for (size_t b = 0; b + 1 < sizeof(bounds) / sizeof(bounds[0]); ++b) {
+        src.for_each_spot_range(
+          bounds[b], bounds[b + 1], [&](size_t id, mqi::beamlet<float>&, size_t f, size_t l) {
+              ASSERT_EQ(f, next);
+              ASSERT_TRUE(l > f);
+              for (size_t h = f; h < l; ++h)
+                  ASSERT_EQ(id, spot_of[h]);
+              next = l;
+          });
+        ASSERT_EQ(next, bounds[b + 1]);
+    }
+
+    ///< vertices of the walk are those of the per-history lookup
+    mqi::philox4x32                   rng_a(7), rng_b(7);
+    std::vector<mqi::vertex_t<float>> walked;
+    src.for_each_spot_range(0, 14, [&](size_t, mqi::beamlet<float>& bl, size_t f, size_t l) {
+        for (size_t h = f; h < l; ++h)
+            walked.push_back(bl(&rng_a));
+    });
+    ASSERT_EQ(walked.size(), size_t(14));
+    for (size_t h = 0; h < walked.size(); ++h) {
+        mqi::beamlet<float>  bl = src(h);
+        mqi::vertex_t<float> v  = bl(&rng_b);
+        ASSERT_EQ(walked[h].ke, v.ke);
+        ASSERT_EQ(walked[h].pos.x, v.pos.x);
+        ASSERT_EQ(walked[h].pos.y, v.pos.y);
+    }
+}
+
+// Test 2: Vertices sampled on several threads do not depend on the thread count
+TEST(Beamsource_ParallelVerticesIndependentOfThreads) {
+    const std::vector<size_t>         histories = { 700, 0, 1500, 20, 900 };
+    std::vector<mqi::const_1d<float>> energies;
+    std::vector<mqi::phsp_6d<float>>  fluences;
+    mqi::beamsource<float>            src = make_source(histories, energies, fluences);
+    const size_t                      n   = src.total_histories();
+
+    std::vector<mqi::vertex_t<float>> serial(n);
+    src.sample_vertices(0, n, serial.data(), 3, 1);
+    for (uint32_t n_threads : { 2, 5 }) {
+        mqi::thread_pool                  pool(n_threads);
+        std::vector<mqi::vertex_t<float>> v(n);
+        ///< two batches, the second one starting inside a spot
+        src.sample_vertices(0, 1000, v.data(), 3, 1, &pool);
+        src.sample_vertices(1000, n, v.data() + 1000, 3, 1, &pool);
+        for (size_t h = 0; h < n; ++h) {
+            ASSERT_EQ(v[h].ke, serial[h].ke);
+            ASSERT_EQ(v[h].pos.x, serial[h].pos.x);
+            ASSERT_EQ(v[h].dir.y, serial[h].dir.y);
+        }
+    }
+
+    ///< histories of a spot differ, other seeds differ
+    ASSERT_TRUE(serial[0].pos.x != serial[1].pos.x);
+    std::vector<mqi::vertex_t<float>> other(n);
+    src.sample_vertices(0, n, other.data(), 4, 1);
+    ASSERT_TRUE(other[0].pos.x != serial[0].pos.x);
+}
+
+// Test 3: Spots of the arena sample the vertices of their virtual beamlets
+TEST(BeamletArena_MatchesVirtualBeamlets) {
+    mqi::beamsource<float> src;
+    src.arena_ = std::make_shared<mqi::beamlet_arena<float>>();
+    mqi::coordinate_transform<float> p;
+    p.rotation    = mqi::mat3x3<float>(0.0, 0.0, 90.0);
+    p.translation = mqi::vec3<float>(1, 2, 3);
+    for (int i = 0; i < 4; ++i) {
+        const float dx = 0.01f * i, dy = -0.005f * i;
+        src.append_beamlet_log(src.arena_->append(100.0f + 10 * i,
+                                                  0.8f,
+                                                  { 20.0f * i, -5.0f, 400.0f, dx, dy, -1.0f },
+                                                  { 4.0f, 4.5f, 0.0f, 0.002f, 0.003f, 0.0f },
+                                                  { 0.01f, 0.02f },
+                                                  -465.0f - 40 * (i % 2)),
+                               100 * i + 50,
+                               p);
+    }
+    const size_t                      n = src.total_histories();
+    std::vector<mqi::vertex_t<float>> arena(n), virt(n);
+    src.sample_vertices(0, n, arena.data(), 9, 2);
+    std::shared_ptr<mqi::beamlet_arena<float>> keep = src.arena_;
+    src.arena_.reset();   ///< falls back to the beamlets
+    src.sample_vertices(0, n, virt.data(), 9, 2);
+    for (size_t h = 0; h < n; ++h) {
+        ASSERT_NEAR(arena[h].ke, virt[h].ke, 1e-4);
+        ASSERT_NEAR(arena[h].pos.x, virt[h].pos.x, 1e-3);
+        ASSERT_NEAR(arena[h].pos.y, virt[h].pos.y, 1e-3);
+        ASSERT_NEAR(arena[h].pos.z, virt[h].pos.z, 1e-3);
+        ASSERT_NEAR(arena[h].dir.x, virt[h].dir.x, 1e-6);
+        ASSERT_NEAR(arena[h].dir.y, virt[h].dir.y, 1e-6);
+        ASSERT_NEAR(arena[h].dir.z, virt[h].dir.z, 1e-6);
+    }
+    ASSERT_TRUE(arena[0].pos.x != arena[1].pos.x);
+}
+
+int main() {
+    return mqi_test::TestRunner::instance().run_all();
+}
@@ -0,0 +1,153 @@
+#include "test_framework.hpp"
+#include <moqui/base/mqi_grid3d.hpp>
+#include <random>
+#include <vector>
+
+namespace
+{
+
+///< Edge-by-edge scan along one axis (reference for grid3d::index)
+mqi::ijk_t
+scan_index(const float* e, mqi::ijk_t n, float p, float d) {
+    mqi::ijk_t idx = -1;
+    for (int ind = 0; ind < n; ind++) {
+        if (mqi::mqi_abs(e[ind] - p) < mqi::geometry_tolerance) {
+            return (d < 0) ? ind - 1 : ind;
+        } else if (mqi::mqi_abs(e[ind + 1] - p) < mqi::geometry_tolerance) {
+            return (d > 0) ? ind + 1 : ind;
+        } else if (e[ind] - p < 0 && e[ind + 1] - p > 0) {
+            return ind;
+        }
+    }
+    return idx;
+}
+
+///< Compare grid3d::index with the scan for random points, on and off edges
+void
+check_against_scan(mqi::grid3d<mqi::density_t, float>& grid) {
+    std::mt19937                          gen(11);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    const mqi::vec3<mqi::ijk_t>           dim = grid.get_nxyz();
+    const float*                          e[3] = { grid.get_x_edges(),
+                                                   grid.get_y_edges(),
+                                                   grid.get_z_edges() };
+    const mqi::ijk_t                      n[3] = { dim.x, dim.y, dim.z };
+    for (int trial = 0; trial < 20000; ++trial) {
+        float p[3], d[3];
+        for (int a = 0; a < 3; ++a) {
+            const float lo = e[a][0], hi = e[a][n[a]];
+            const float u  = unit(gen);
+            if (u < 0.3f) {
+                ///< on an edge, up to just below the tolerance
+                const int   k = static_cast<int>(unit(gen) * (n[a] + 1)) % (n[a] + 1);
+                const float s = (unit(gen) - 0.5f) * 1.8e-3f;
+                p[a]          = e[a][k] + s;
+            } else {
+                p[a] = lo - 2.0f + (hi - lo + 4.0f) * unit(gen);
+            }
+            const float r = unit(gen);
+            d[a]          = (r < 0.1f) ? 0.0f : ((r < 0.55f) ? -1.0f : 1.0f);
+        }
+        mqi::vec3<float>      pos(p[0], p[1], p[2]);
+        mqi::vec3<float>      dir(d[0], d[1], d[2]);
+        mqi::vec3<mqi::ijk_t> idx = grid.index(pos, dir);
+        ASSERT_EQ(idx.x, scan_index(e[0], n[0], p[0], d[0]));
+        ASSERT_EQ(idx.y, scan_index(e[1], n[1], p[1], d[1]));
+        ASSERT_EQ(idx.z, scan_index(e[2], n[2], p[2], d[2]));
+    }
+}
+
+}   // namespace
+
+// Test 1: Direct index on uniform axes matches the edge scan
+TEST(Grid3d_UniformIndexMatchesScan) {
+    mqi::grid3d<mqi::density_t, float> grid(-25.6f, 25.6f, 257, -10.0f, 10.0f, 11, 0.0f, 30.0f, 61);
+    check_against_scan(grid);
+}
+
+// Test 2: Binary search on a non-uniform axis (variable slice thickness) matches the scan
+TEST(Grid3d_NonUniformIndexMatchesScan) {
+    std::vector<float> xe, ye, ze;
+    for (int i = 0; i <= 64; ++i)
+        xe.push_back(-16.0f + 0.5f * i);
+    for (int i = 0; i <= 8; ++i)
+        ye.push_back(-4.0f + i);
+    float z = -20.0f;
+    for (int i = 0; i <= 40; ++i) {
+        ze.push_back(z);
+        z += (i < 10) ? 3.0f : ((i < 30) ? 1.25f : 2.5f);
+    }
+    mqi::grid3d<mqi::density_t, float> grid(
+      xe.data(), xe.size(), ye.data(), ye.size(), ze.data(), ze.size());
+    check_against_scan(grid);
+}
+
+// Test 3: Incremental traversal gives the per-step intersect distances along a ray
+TEST(Grid3d_TraversalMatchesIntersect) {
+    std::vector<float> ze(1, 0.0f);
+    for (int i = 1; i <= 30; ++i)
+        ze.push_back(ze.back() + 1.0f + 0.25f * (i % 4));
+    std::vector<float> xe, ye;
+    for (int i = 0; i <= 40; ++i) {
+        xe.push_back(-10.0f + 0.5f * i);
+        ye.push_back(-10.0f + 0.5f * i);
+    }
+    mqi::grid3d<mqi::density_t, float> grid(
+      xe.data(), xe.size(), ye.data(), ye.size(), ze.data(), ze.size());
+
+    std::mt19937                          gen(3);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    for (int ray = 0; ray < 200; ++ray) {
+        mqi::vec3<float> pos(2.0f * unit(gen), 2.0f * unit(gen), 0.3f);
+        mqi::vec3<float> dir(unit(gen), unit(gen), 1.5f + unit(gen));
+        if (ray % 10 == 0) dir.x = 0.0f;   ///< ray in a plane of the grid
+        dir.normalize();
+        mqi::vec3<mqi::ijk_t> cell = grid.index(pos, dir);
+        mqi::dda_t<float>     dda;
+        int                   n_steps = 0;
+        while (grid.is_valid(cell) && n_steps < 1000) {
+            mqi::vec3<float>        d_ref = dir;
+            mqi::intersect_t<float> ref   = grid.intersect(pos, d_ref, cell);
+            mqi::intersect_t<float> its   = grid.intersect(pos, dir, cell, dda);
+            ASSERT_NEAR(its.dist, ref.dist, 1e-3 * (1.0f + ref.dist));
+            if (its.dist < 0) break;
+            ///< a short step every few voxels, as a physics process would do
+            const float step = (n_steps % 3 == 0) ? 0.5f * its.dist : its.dist;
+            pos              = pos + dir * step;
+            ///< direction change half way re-seeds the traversal
+            if (n_steps == 20) {
+                dir.y = -dir.y;
+            }
+            grid.index(pos, dir, cell);
+            n_steps++;
+        }
+        ASSERT_TRUE(n_steps > 10);
+    }
+}
+
+// Test 4: Super-voxel flags and the distance to the faces of a homogeneous block
+TEST(Grid3d_SuperVoxelBlocks) {
+    mqi::grid3d<mqi::density_t, float> grid(0.0f, 10.0f, 11, 0.0f, 10.0f, 11, 0.0f, 10.0f, 11);
+    mqi::density_t*                    rho = new mqi::density_t[1000];
+    for (int v = 0; v < 1000; ++v)
+        rho[v] = 1.0e-3f;
+    rho[grid.ijk2cnb(9, 9, 9)] = 1.2e-3f;   ///< last (partial) block is not homogeneous
+    grid.set_data(rho);
+    grid.build_super_voxels(4, 0.01f);
+    ASSERT_EQ(grid.n_homogeneous_blocks(), 26u);
+
+    mqi::vec3<float> pos(1.5f, 2.5f, 0.25f);
+    mqi::vec3<float> dir(0.0f, 0.0f, 1.0f);
+    ASSERT_NEAR(grid.super_voxel_distance(pos, dir, grid.index(pos, dir)), 3.75f, 1e-5);
+    pos = mqi::vec3<float>(9.5f, 9.5f, 8.5f);
+    ASSERT_TRUE(grid.super_voxel_distance(pos, dir, grid.index(pos, dir)) < 0);
+    ///< the partial block along x ends at the grid edge
+    pos = mqi::vec3<float>(8.5f, 0.5f, 0.5f);
+    dir = mqi::vec3<float>(1.0f, 0.0f, 0.0f);
+    ASSERT_NEAR(grid.super_voxel_distance(pos, dir, grid.index(pos, dir)), 1.5f, 1e-5);
+    grid.delete_data_if_used();
+}
+
+int main() {
+    return mqi_test::TestRunner::instance().run_all();
+}
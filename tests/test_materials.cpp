@@ -0,0 +1,37 @@
+#include "test_framework.hpp"
+#include <moqui/base/materials/mqi_material.hpp>
+
+// Test 1: The stopping power ratio table follows the analytic model
+TEST(SprTable_MatchesExact) {
+    mqi::spr_table_t table;
+    table.build();
+    double max_diff = 0;
+    for (int i = 0; i <= 400; ++i) {
+        const float density = 0.001f + 2.0f * i / 400;
+        ///< 0.5 to 350 MeV, finest in the Bragg-peak energies
+        for (int j = 0; j <= 1400; ++j) {
+            const float  Ek   = (j < 400) ? 0.5f + 0.025f * j : 10.0f + 0.34f * (j - 400);
+            const double diff = std::abs(table.lookup(density, Ek) -
+                                         mqi::spr_exact<double>(density, Ek));
+            if (diff > max_diff) max_diff = diff;
+        }
+    }
+    ASSERT_TRUE(max_diff < 1e-4);
+}
+
+// Test 2: material_t switches between the table and the exact routine
+TEST(SprTable_SelectableInMaterial) {
+    mqi::h2o_t<float> lung;
+    lung.rho_mass      = 0.4e-3f;
+    const float exact  = lung.stopping_power_ratio(50.0f);
+    mqi::spr_table.build();
+    const float table  = lung.stopping_power_ratio(50.0f);
+    mqi::spr_table.enabled = false;
+    ASSERT_NEAR(exact, mqi::spr_exact<float>(0.4f, 50.0f), 1e-6);
+    ASSERT_NEAR(table, exact, 1e-4);
+    ASSERT_NEAR(lung.stopping_power_ratio(50.0f), exact, 0.0);
+}
+
+int main() {
+    return mqi_test::TestRunner::instance().run_all();
+}
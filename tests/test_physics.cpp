@@ -0,0 +1,80 @@
+#include "test_framework.hpp"
+#include <moqui/base/mqi_fippel_physics.hpp>
+
+// Test 1: The interleaved table gives the cross-sections of the four processes
+TEST(CrossSectionTable_MatchesProcesses) {
+    mqi::fippel_physics<float> fippel;
+    mqi::h2o_t<float>          mat;
+    mat.rho_mass = 1.1e-3f;
+    double max_rel_diff = 0;
+    for (int i = 0; i <= 6100; ++i) {
+        const float                          Ek = 0.05f + 0.0493f * i;
+        mqi::relativistic_quantities<float> rel(Ek, fippel.units.Mp);
+        const float ref[4] = { fippel.p_ion.cross_section(rel, mat),
+                               fippel.pp_e.cross_section(rel, mat),
+                               fippel.po_e.cross_section(rel, mat),
+                               fippel.po_i.cross_section(rel, mat) };
+        float cs[4];
+        fippel.cross_sections(Ek, mat, cs);
+        for (int p = 0; p < 4; ++p) {
+            const double diff = std::abs(cs[p] - ref[p]);
+            if (ref[p] == 0) {
+                ASSERT_TRUE(diff < 1e-9);
+            } else if (diff / ref[p] > max_rel_diff) {
+                max_rel_diff = diff / ref[p];
+            }
+        }
+    }
+    ASSERT_TRUE(max_rel_diff < 5e-4);   ///< float rounding of the bin edges
+}
+
+// Test 2: along_step with the step context gives the same track as without it
+TEST(StepContext_AlongStepUnchanged) {
+    mqi::fippel_physics<float> fippel;
+    mqi::h2o_t<float>          mat;
+    mqi::track_stack_t<float>  stk;
+    mqi::vertex_t<float>       v;
+    v.pos = mqi::vec3<float>(0, 0, 0);
+    v.dir = mqi::vec3<float>(0, 0, 1);
+    for (float rho : { 0.3e-3f, 1.0e-3f, 1.7e-3f }) {
+        mat.rho_mass = rho;
+        for (float ke : { 3.0f, 70.0f, 220.0f }) {
+            v.ke = ke;
+            mqi::track_t<float> a(v), b(v);
+            mqi::mqi_rng        rng_a, rng_b;
+            rng_a.seed(3);
+            rng_b.seed(3);
+            const mqi::step_context_t<float> ctx = fippel.p_ion.context(ke, mat);
+            fippel.p_ion.along_step(a, stk, &rng_a, 0.8f, mat, ctx);
+            mqi::relativistic_quantities<float> rel(ke, fippel.units.Mp);
+            ASSERT_NEAR(ctx.dEdx, fippel.p_ion.dEdx(rel, mat), 0.0);
+            ///< the virtual along_step builds its own context
+            static_cast<mqi::interaction<float, mqi::PROTON>&>(fippel.p_ion)
+              .along_step(b, stk, &rng_b, 0.8f, mat);
+            ASSERT_NEAR(a.vtx1.ke, b.vtx1.ke, 0.0);
+            ASSERT_NEAR(a.dE, b.dE, 0.0);
+            ASSERT_NEAR(a.vtx1.dir.x, b.vtx1.dir.x, 0.0);
+            ASSERT_NEAR(a.vtx1.pos.z, b.vtx1.pos.z, 0.0);
+        }
+    }
+}
+
+// Test 3: The inverse range table finds the interval of the backward scan
+TEST(InverseRangeTable_MatchesScan) {
+    const mqi::inverse_range_table& table = mqi::inverse_range_table::host();
+    const float*                    r     = mqi::range_steps;
+    for (uint16_t n_start = 1; n_start < 599; n_start += 7) {
+        for (int k = 0; k <= 400; ++k) {
+            const float residual = r[n_start + 1] * k / 400.0f;
+            uint16_t    n        = n_start;
+            do {
+                if (residual >= r[n]) break;
+            } while (--n > 0);
+            ASSERT_EQ(table.node(r, residual, n_start), n);
+        }
+    }
+}
+
+int main() {
+    return mqi_test::TestRunner::instance().run_all();
+}
@@ -0,0 +1,155 @@
+#include "test_framework.hpp"
+#include <moqui/base/mqi_math.hpp>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace
+{
+
+///< Pearson chi-square of samples of F in n_bins of equal probability, below
+///< a loose bound of dof + 5 sqrt(2 dof) for a fixed seed
+template<class Sample, class Quantile>
+void
+check_chi_square(Sample sample, Quantile quantile, uint32_t n, uint32_t n_bins) {
+    std::vector<double> edges(n_bins - 1);
+    for (uint32_t b = 1; b < n_bins; ++b)
+        edges[b - 1] = quantile(double(b) / n_bins);
+    std::vector<uint32_t> counts(n_bins, 0);
+    for (uint32_t i = 0; i < n; ++i) {
+        const double x = sample();
+        counts[std::upper_bound(edges.begin(), edges.end(), x) - edges.begin()]++;
+    }
+    const double expected = double(n) / n_bins;
+    double       chi2     = 0;
+    for (uint32_t c : counts)
+        chi2 += (c - expected) * (c - expected) / expected;
+    const double dof = n_bins - 1;
+    ASSERT_TRUE(chi2 < dof + 5.0 * std::sqrt(2.0 * dof));
+}
+
+///< Inverse of the standard normal CDF by bisection on erfc
+double
+normal_quantile(double p) {
+    double lo = -10, hi = 10;
+    for (int it = 0; it < 100; ++it) {
+        const double mid = 0.5 * (lo + hi);
+        if (0.5 * std::erfc(-mid / std::sqrt(2.0)) < p) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return 0.5 * (lo + hi);
+}
+
+}   // namespace
+
+// Test 1: Philox4x32-10 reproduces the known-answer vectors of its reference implementation
+TEST(Philox_KnownAnswers) {
+    uint32_t       out[4];
+    const uint32_t zero_ctr[4] = { 0, 0, 0, 0 };
+    const uint32_t zero_key[2] = { 0, 0 };
+    mqi::philox4x32::block(zero_ctr, zero_key, out);
+    ASSERT_EQ(out[0], 0x6627e8d5u);
+    ASSERT_EQ(out[1], 0xe169c58du);
+    ASSERT_EQ(out[2], 0xbc57ac4cu);
+    ASSERT_EQ(out[3], 0x9b00dbd8u);
+    const uint32_t ones_ctr[4] = { 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff };
+    const uint32_t ones_key[2] = { 0xffffffff, 0xffffffff };
+    mqi::philox4x32::block(ones_ctr, ones_key, out);
+    ASSERT_EQ(out[0], 0x408f276du);
+    ASSERT_EQ(out[1], 0x41c83b0eu);
+    ASSERT_EQ(out[2], 0xa20bc7c6u);
+    ASSERT_EQ(out[3], 0x6d5451fdu);
+}
+
+// Test 2: A history stream only depends on (seed, beam, spot, history)
+TEST(Philox_StreamsDependOnIdentity) {
+    mqi::mqi_rng a(5, 1), b(5, 1);
+    b.discard(1000);   ///< b was used by other histories before
+    a.stream(3, 12345);
+    b.stream(3, 12345);
+    for (int n = 0; n < 100; ++n)
+        ASSERT_EQ(a(), b());
+    mqi::mqi_rng c(5, 2);   ///< other beam
+    a.stream(3, 12345);
+    c.stream(3, 12345);
+    ASSERT_TRUE(a() != c());
+}
+
+// Test 3: Uniform numbers stay in [0, 1) with the expected mean and variance
+TEST(Philox_UniformMoments) {
+    mqi::mqi_rng rng(11);
+    const int    n = 200000;
+    double       sum_f = 0, sum2_f = 0, sum_d = 0;
+    for (int i = 0; i < n; ++i) {
+        const float  u = mqi::mqi_uniform<float>(&rng);
+        const double v = mqi::mqi_uniform<double>(&rng);
+        ASSERT_TRUE(u >= 0.0f && u < 1.0f);
+        ASSERT_TRUE(v >= 0.0 && v < 1.0);
+        sum_f += u;
+        sum2_f += double(u) * u;
+        sum_d += v;
+    }
+    ASSERT_NEAR(sum_f / n, 0.5, 0.003);
+    ASSERT_NEAR(sum2_f / n - (sum_f / n) * (sum_f / n), 1.0 / 12.0, 0.002);
+    ASSERT_NEAR(sum_d / n, 0.5, 0.003);
+}
+
+// Test 4: Ziggurat normal numbers have the moments, the shape and the tail of N(avg, sig)
+TEST(Ziggurat_NormalDistribution) {
+    mqi::mqi_rng rng(21);
+    const int    n    = 1000000;
+    double       sum  = 0, sum2 = 0, sum3 = 0, sum4 = 0;
+    int          tail = 0;
+    for (int i = 0; i < n; ++i) {
+        const double x = mqi::mqi_normal<float>(&rng, 0.0f, 1.0f);
+        sum += x;
+        sum2 += x * x;
+        sum3 += x * x * x;
+        sum4 += x * x * x * x;
+        if (std::abs(x) > 3.442619855899) tail++;
+    }
+    ASSERT_NEAR(sum / n, 0.0, 0.005);
+    ASSERT_NEAR(sum2 / n, 1.0, 0.005);
+    ASSERT_NEAR(sum3 / n, 0.0, 0.02);
+    ASSERT_NEAR(sum4 / n, 3.0, 0.05);
+    ///< P(|x| > r) = 5.76e-4, sampled by the base layer
+    ASSERT_NEAR(double(tail) / n, 5.76e-4, 1e-4);
+    check_chi_square([&] { return mqi::mqi_normal<float>(&rng, 0.0f, 1.0f); },
+                     normal_quantile,
+                     n,
+                     200);
+    ASSERT_NEAR(mqi::mqi_normal<double>(&rng, 5.0, 0.0), 5.0, 1e-12);
+}
+
+// Test 5: Ziggurat exponential numbers follow exp(-avg x), the double version below up
+TEST(Ziggurat_ExponentialDistribution) {
+    mqi::mqi_rng rng(22);
+    const int    n   = 1000000;
+    double       sum = 0, sum2 = 0;
+    int          tail = 0;
+    for (int i = 0; i < n; ++i) {
+        const double x = mqi::mqi_exponential<float>(&rng, 2.0f, 100.0f);
+        ASSERT_TRUE(x >= 0);
+        sum += x;
+        sum2 += x * x;
+        if (2.0 * x > 7.697117470131487) tail++;
+    }
+    ASSERT_NEAR(sum / n, 0.5, 0.002);
+    ASSERT_NEAR(sum2 / n - (sum / n) * (sum / n), 0.25, 0.003);
+    ASSERT_NEAR(double(tail) / n, std::exp(-7.697117470131487), 1e-4);
+    check_chi_square([&] { return mqi::mqi_exponential<float>(&rng, 1.0f, 100.0f); },
+                     [](double p) { return -std::log(1.0 - p); },
+                     n,
+                     200);
+    for (int i = 0; i < 10000; ++i) {
+        const double x = mqi::mqi_exponential<double>(&rng, 1.0, 0.5);
+        ASSERT_TRUE(x > 0 && x <= 0.5);
+    }
+}
+
+int main() {
+    return mqi_test::TestRunner::instance().run_all();
+}
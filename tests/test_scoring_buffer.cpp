@@ -0,0 +1,272 @@
+#include "test_framework.hpp"
+#include <moqui/kernel_functions/mqi_scoring_reduction.hpp>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace
+{
+
+double
+unit_hit(const mqi::track_t<float>&, const mqi::cnb_t&, mqi::grid3d<mqi::density_t, float>&) {
+    return 1.0;
+}
+
+///< A world with one 10x10x10 child holding one scorer table
+struct test_world_t {
+    mqi::grid3d<mqi::density_t, float> geo;
+    mqi::scorer<float>                 scr;
+    mqi::scorer<float>*                scorers[1];
+    mqi::node_t<float>                 child;
+    mqi::node_t<float>*                children[1];
+    mqi::node_t<float>                 world;
+
+    test_world_t() :
+        geo(0.0f, 10.0f, 11, 0.0f, 10.0f, 11, 0.0f, 10.0f, 11), scr("dose", 1000, unit_hit) {
+        scr.data_ = new mqi::key_value[scr.max_capacity_];
+        mqi::init_table(scr.data_, scr.max_capacity_);
+        scorers[0]       = &scr;
+        child.geo        = &geo;
+        child.n_scorers  = 1;
+        child.scorers    = scorers;
+        children[0]      = &child;
+        world.n_children = 1;
+        world.children   = children;
+    }
+};
+
+///< Deposit the same pseudo-random sequence split into n_slices slices
+void
+fill_slices(std::vector<mqi::scoring_buffer>& slices) {
+    std::mt19937                           gen(7);
+    std::uniform_int_distribution<int>     voxel(0, 999);
+    std::uniform_real_distribution<double> value(1e-6, 1.0);
+    const uint32_t                         n_deposits = 20000;
+    for (uint32_t d = 0; d < n_deposits; ++d) {
+        mqi::vec2<uint32_t> r;
+        uint32_t            slice = 0;
+        for (; slice < slices.size(); ++slice) {
+            r = mqi::start_and_length(slices.size(), n_deposits, slice);
+            if (d < r.x + r.y) break;
+        }
+        slices[slice].add(voxel(gen), mqi::empty_pair, value(gen));
+    }
+}
+
+}   // namespace
+
+// Test 1: A private buffer accumulates per key and survives growth
+TEST(ScoringBuffer_AccumulateAndGrow) {
+    mqi::scoring_buffer buffer(16);
+    for (uint32_t i = 0; i < 500; ++i) {
+        buffer.add(i, 3, 1.0);
+        buffer.add(i, 3, 0.5);
+    }
+    buffer.add(1, 3, -1.0);   // ignored
+    ASSERT_EQ(buffer.size(), size_t(500));
+    double total = 0.0;
+    buffer.for_each([&](mqi::key_t, mqi::key_t key2, double value) {
+        ASSERT_EQ(key2, 3u);
+        total += value;
+    });
+    ASSERT_NEAR(total, 750.0, 1e-12);
+    buffer.clear();
+    ASSERT_EQ(buffer.size(), size_t(0));
+}
+
+// Test 2: The merge is bitwise identical for any number of merging threads
+TEST(ScoringBuffer_ReductionIsDeterministic) {
+    std::vector<double> reference;
+    for (uint32_t n_threads : { 1u, 3u, 8u }) {
+        test_world_t                     w;
+        std::vector<mqi::scoring_buffer> slices(16);
+        fill_slices(slices);
+        mqi::thread_pool pool(n_threads);
+        mc::reduce_scoring_buffers<float>(pool, &w.world, slices.data(), slices.size());
+        std::vector<double> result(1000);
+        for (uint32_t i = 0; i < 1000; ++i) {
+            ASSERT_TRUE(w.scr.data_[i].key1 == i || w.scr.data_[i].key1 == mqi::empty_pair);
+            result[i] = w.scr.data_[i].value;
+        }
+        if (reference.empty()) {
+            reference = result;
+        } else {
+            ASSERT_TRUE(std::memcmp(reference.data(), result.data(), 1000 * sizeof(double)) == 0);
+        }
+        for (auto& slice : slices)
+            ASSERT_EQ(slice.size(), size_t(0));
+    }
+}
+
+// Test 3: Packed and key_value tables claim keys with one CAS under contention
+TEST(PackedTable_ConcurrentInsert) {
+    mqi::packed_table table(4096);
+    ASSERT_EQ(table.capacity_ % mqi::packed_table::bucket_slots, 0u);
+    mqi::thread_pool pool(8);
+    pool.run([&](uint32_t, uint32_t) {
+        for (uint32_t n = 0; n < 20000; ++n) {
+            mc::insert_packed_table(&table, n % 100, n % 7, 1.0);
+        }
+    });
+    ASSERT_EQ(table.overflow_, 0ULL);
+
+    mqi::scorer<float> scr("dose", table.capacity_, unit_hit);
+    scr.packed_ = &table;
+    std::vector<double> per_key(700, 0.0);
+    uint32_t            n_keys = 0;
+    for (uint32_t ind = 0; ind < scr.max_capacity_; ++ind) {
+        const mqi::key_value e = scr.entry(ind);
+        if (e.key1 == mqi::empty_pair) continue;
+        per_key[e.key1 * 7 + e.key2] += e.value;
+        n_keys++;
+    }
+    scr.packed_ = nullptr;
+    ///< every (key1, key2) pair that occurs owns exactly one slot
+    ASSERT_EQ(n_keys, 700u);
+    double total = 0.0;
+    for (double v : per_key)
+        total += v;
+    ASSERT_NEAR(total, 160000.0, 1e-9);
+
+    ///< key_value table: no slot ends up with the key1 of one pair and the key2 of another
+    std::vector<mqi::key_value> kv(4096);
+    mqi::init_table(kv.data(), kv.size());
+    pool.run([&](uint32_t, uint32_t) {
+        for (uint32_t n = 0; n < 20000; ++n) {
+            mc::insert_hashtable<float>(kv.data(), n % 100, n % 7, 1.0, 0, kv.size());
+        }
+    });
+    n_keys = 0;
+    total  = 0.0;
+    for (const mqi::key_value& e : kv) {
+        if (e.key1 == mqi::empty_pair) continue;
+        ASSERT_TRUE(e.key1 < 100 && e.key2 < 7);
+        total += e.value;
+        n_keys++;
+    }
+    ASSERT_EQ(n_keys, 700u);
+    ASSERT_NEAR(total, 160000.0, 1e-9);
+}
+
+// Test 4: Direct voxel keys keep their slot; long probes still store the deposit and only
+// a full table reports overflow
+TEST(PackedTable_DirectKeysAndOverflow) {
+    mqi::packed_table table(64, 8);
+    for (uint32_t v = 0; v < 64; ++v)
+        mc::insert_packed_table(&table, v, mqi::empty_pair, 2.0);
+    for (uint32_t v = 0; v < 64; ++v) {
+        const mqi::key_value e = table.entry(v);
+        ASSERT_EQ(e.key1, v);
+        ASSERT_EQ(e.key2, 0u);
+        ASSERT_NEAR(e.value, 2.0, 1e-12);
+    }
+    ASSERT_FALSE(mc::insert_packed_table(&table, 100, 5, 1.0));
+    ASSERT_EQ(table.overflow_, 1ULL);
+
+    mqi::packed_table crowded(64, 1);
+    for (uint32_t k = 0; k < 64; ++k)
+        ASSERT_TRUE(mc::insert_packed_table(&crowded, k, 3, 1.0));
+    ASSERT_TRUE(crowded.long_probes_ > 0);
+    ASSERT_EQ(crowded.overflow_, 0ULL);
+    double total = 0.0;
+    for (uint32_t slot = 0; slot < crowded.capacity_; ++slot)
+        total += crowded.entry(slot).value;
+    ASSERT_NEAR(total, 64.0, 1e-12);
+}
+
+// Test 5: Dense scorer sums per voxel under contention and reads back as key_value
+TEST(DenseScorer_ConcurrentDeposit) {
+    mqi::scorer<float> scr("dose", 100, unit_hit);
+    scr.dense_ = new double[scr.max_capacity_]();
+    mqi::thread_pool pool(8);
+    pool.run([&](uint32_t, uint32_t) {
+        for (uint32_t n = 0; n < 10000; ++n)
+            mc::score_hit<float>(&scr, n % 50, mqi::empty_pair, 0.5, scr.max_capacity_);
+        mc::score_hit<float>(&scr, 60, mqi::empty_pair, -1.0, scr.max_capacity_);   // ignored
+    });
+    for (uint32_t v = 0; v < 100; ++v) {
+        const mqi::key_value e = scr.entry(v);
+        if (v < 50) {
+            ASSERT_EQ(e.key1, v);
+            ASSERT_EQ(e.key2, 0u);
+            ASSERT_NEAR(e.value, 800.0, 1e-9);
+        } else {
+            ASSERT_EQ(e.key1, mqi::empty_pair);
+        }
+    }
+    scr.clear_data();
+    ASSERT_EQ(scr.entry(0).key1, mqi::empty_pair);
+}
+
+// Test 6: Companion quantities share the key of the value through buffers and merge
+TEST(ScoringBuffer_MergesCompanionQuantities) {
+    test_world_t       w;
+    mqi::scorer<float> scr("dose", 1000, unit_hit, mqi::DOSE_LETD_HIT);
+    scr.data_ = new mqi::key_value[scr.max_capacity_];
+    mqi::init_table(scr.data_, scr.max_capacity_);
+    scr.allocate_quantities();
+    w.scorers[0] = &scr;
+
+    std::vector<mqi::scoring_buffer> slices(4);
+    double                           expected[3] = { 1.0, 0.0, 0.0 };
+    slices[0].add(5, mqi::empty_pair, 1.0);   ///< widened to three quantities below
+    for (uint32_t d = 0; d < 4000; ++d) {
+        const double v[3] = { 1.0 + d % 3, 2.0 * (1.0 + d % 3), 0.5 };
+        slices[d % 4].add(d % 500, mqi::empty_pair, v, 3);
+        for (uint8_t q = 0; q < 3; ++q)
+            expected[q] += v[q];
+    }
+    ASSERT_EQ(slices[0].n_values(), 3);
+    mqi::thread_pool pool(3);
+    mc::reduce_scoring_buffers<float>(pool, &w.world, slices.data(), slices.size());
+    double total[3] = { 0, 0, 0 };
+    for (uint32_t ind = 0; ind < scr.max_capacity_; ++ind) {
+        for (uint8_t q = 0; q < 3; ++q)
+            total[q] += scr.quantity(ind, q);
+    }
+    for (uint8_t q = 0; q < 3; ++q)
+        ASSERT_NEAR(total[q], expected[q], 1e-9);
+    ASSERT_NEAR(scr.quantity(7, 1), 2.0 * scr.quantity(7, 0), 1e-9);
+    w.scorers[0] = &w.scr;
+}
+
+// Test 7: The CONTOUR bitmap gives the membership and scorer index of the run search
+TEST(Roi_ContourBitmapMatchesSearch) {
+    const uint32_t        n = 11 * 9 * 7;
+    std::vector<uint8_t>  mask(n, 0);
+    std::vector<uint32_t> start, stride, acc_stride;
+    std::mt19937          gen(3);
+    for (uint32_t v = 1; v < n; ++v)
+        mask[v] = (gen() % 4 == 0) ? !mask[v - 1] : mask[v - 1];
+    mask[n - 1] = 1;   ///< a run reaching the last voxel
+    for (uint32_t v = 0; v < n; ++v) {
+        if (mask[v] && (v == 0 || !mask[v - 1])) start.push_back(v);
+        if (mask[v] && (v + 1 == n || !mask[v + 1])) {
+            stride.push_back(v + 1 - start.back());
+            acc_stride.push_back((acc_stride.empty() ? 0 : acc_stride.back()) + stride.back());
+        }
+    }
+    const mqi::roi_t search(
+      mqi::CONTOUR, n, start.size(), start.data(), stride.data(), acc_stride.data());
+    mqi::roi_t roi = search;
+    roi.build_bitmap();
+    ASSERT_TRUE(roi.bitmap_ != nullptr);
+    int32_t members = 0;
+    for (uint32_t v = 0; v < n; ++v) {
+        ASSERT_EQ(roi.get_mask_idx(v), mask[v] ? members : -1);
+        ASSERT_EQ(roi.idx(v), mask[v] ? 1 : -1);
+        if (v >= start[0]) {
+            ///< the search needs a run starting at or before v
+            ASSERT_EQ(roi.get_mask_idx(v), search.get_mask_idx(v));
+            ASSERT_EQ(roi.idx(v), search.idx(v));
+        }
+        if (mask[v]) members++;
+    }
+    ASSERT_EQ(roi.get_mask_size(), members);
+    delete[] roi.bitmap_;
+    delete[] roi.rank_;
+}
+
+int main() {
+    return mqi_test::TestRunner::instance().run_all();
+}
@@ -0,0 +1,207 @@
+#include "test_framework.hpp"
+#include <moqui/base/mqi_batch_pipeline.hpp>
+#include <moqui/base/mqi_history_scheduler.hpp>
+#include <moqui/base/mqi_thread_pool.hpp>
+#include <moqui/kernel_functions/mqi_transport.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+// Test 1: Every thread runs the job exactly once with a unique id
+TEST(ThreadPool_RunsEveryThreadOnce) {
+    mqi::thread_pool pool(4);
+    ASSERT_EQ(pool.size(), 4u);
+
+    std::vector<std::atomic<int>> calls(4);
+    for (auto& c : calls)
+        c = 0;
+    std::atomic<uint32_t> seen_total(0);
+    pool.run([&](uint32_t thread_id, uint32_t total_threads) {
+        calls[thread_id] += 1;
+        seen_total = total_threads;
+    });
+    for (auto& c : calls)
+        ASSERT_EQ(c.load(), 1);
+    ASSERT_EQ(seen_total.load(), 4u);
+}
+
+// Test 2: The pool is reusable across batches, also on fewer of its threads
+TEST(ThreadPool_ReusedAcrossBatches) {
+    mqi::thread_pool      pool(3);
+    std::atomic<uint32_t> counter(0);
+    for (int batch = 0; batch < 50; ++batch) {
+        pool.run([&](uint32_t, uint32_t) { counter += 1; });
+    }
+    ASSERT_EQ(counter.load(), 150u);
+
+    std::atomic<uint32_t> max_id(0), seen_total(0);
+    counter = 0;
+    for (uint32_t batch = 0; batch < 50; ++batch) {
+        pool.run(
+          [&](uint32_t thread_id, uint32_t total_threads) {
+              counter += 1;
+              if (thread_id > max_id) max_id = thread_id;
+              seen_total = total_threads;
+          },
+          1 + batch % 2);
+    }
+    ASSERT_EQ(counter.load(), 75u);
+    ASSERT_EQ(max_id.load(), 1u);
+    ASSERT_EQ(seen_total.load(), 2u);
+}
+
+// Test 3: start_and_length partitions histories without gaps or overlap
+TEST(ThreadPool_PartitionCoversAllHistories) {
+    const uint32_t    n_jobs = 1001;
+    mqi::thread_pool  pool(7);
+    std::vector<int>  hits(n_jobs, 0);
+    pool.run([&](uint32_t thread_id, uint32_t total_threads) {
+        mqi::vec2<uint32_t> range = mqi::start_and_length(total_threads, n_jobs, thread_id);
+        for (uint32_t i = range.x; i < range.x + range.y; ++i)
+            hits[i] += 1;
+    });
+    for (uint32_t i = 0; i < n_jobs; ++i)
+        ASSERT_EQ(hits[i], 1);
+}
+
+// Test 4: Thread count follows the requested value
+TEST(ThreadPool_ThreadCount) {
+    ASSERT_EQ(mqi::cpu_thread_count(5), 5u);
+    ASSERT_TRUE(mqi::cpu_thread_count(-1) >= 1u);
+    ASSERT_TRUE(mqi::cpu_thread_count(0) >= 1u);
+}
+
+// Test 5: Concurrent scoring into the shared hash table loses no deposit
+TEST(ThreadPool_ConcurrentHashtableInsert) {
+    const uint32_t   capacity = 64;
+    mqi::key_value*  table    = new mqi::key_value[capacity];
+    std::memset(table, 0xff, sizeof(mqi::key_value) * capacity);
+    mqi::init_table(table, capacity);
+
+    mqi::thread_pool pool(8);
+    pool.run([&](uint32_t, uint32_t) {
+        for (uint32_t n = 0; n < 10000; ++n) {
+            mc::insert_hashtable<float>(table, n % 16, mqi::empty_pair, 1.0, 0, capacity);
+        }
+    });
+    double total = 0.0;
+    for (uint32_t i = 0; i < 16; ++i) {
+        ASSERT_EQ(table[i].key1, i);
+        total += table[i].value;
+    }
+    ASSERT_NEAR(total, 80000.0, 1e-9);
+    delete[] table;
+}
+
+// Test 6: Work-stealing dispatch runs every history exactly once
+TEST(Scheduler_CoversAllHistoriesOnce) {
+    const uint32_t         n_histories = 5003;
+    mqi::thread_pool       pool(6);
+    mqi::history_scheduler scheduler(6, 4);
+    std::vector<std::atomic<int>> hits(n_histories);
+    for (auto& h : hits)
+        h = 0;
+    scheduler.run(pool, n_histories, [&](uint32_t, uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; ++i)
+            hits[i] += 1;
+    });
+    uint32_t total = 0;
+    for (auto& st : scheduler.stats())
+        total += st.histories;
+    ASSERT_EQ(total, n_histories);
+    for (uint32_t i = 0; i < n_histories; ++i)
+        ASSERT_EQ(hits[i].load(), 1);
+}
+
+// Test 7: Idle threads steal from a thread with expensive histories
+TEST(Scheduler_StealsFromBusyThread) {
+    const uint32_t         n_histories = 400;
+    mqi::thread_pool       pool(4);
+    mqi::history_scheduler scheduler(4, 1);
+    ///< the first quarter (thread 0 under static partitioning) is expensive
+    scheduler.run(pool, n_histories, [&](uint32_t, uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; ++i)
+            if (i < n_histories / 4) std::this_thread::sleep_for(std::chrono::microseconds(200));
+    });
+    uint32_t steals = 0;
+    for (auto& st : scheduler.stats())
+        steals += st.steals;
+    ASSERT_TRUE(steals > 0);
+    ASSERT_TRUE(scheduler.stats()[0].histories < n_histories / 4);
+}
+
+// Test 8: The pipeline consumes every batch in order, producing at most one ahead
+TEST(Pipeline_OverlapsStagesInOrder) {
+    typedef std::vector<uint32_t> buffer_t;
+    std::vector<buffer_t>         buffers(2, buffer_t(16));
+    mqi::batch_pipeline<buffer_t> pipeline(buffers);
+    std::atomic<uint32_t>         produced(0);
+    uint32_t                      consumed = 0;
+
+    auto produce = [&](uint32_t batch, buffer_t& b) {
+        for (uint32_t& v : b)
+            v = batch;
+        produced++;
+    };
+    auto consume = [&](uint32_t batch, buffer_t& b) {
+        ASSERT_EQ(batch, consumed);
+        ASSERT_EQ(b[0], batch);
+        ASSERT_EQ(b[15], batch);
+        ASSERT_TRUE(produced <= batch + 2);
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        consumed++;
+        return true;
+    };
+    ASSERT_EQ(pipeline.run(7, produce, consume), 7u);
+    ASSERT_EQ(consumed, 7u);
+    ASSERT_EQ(pipeline.producer_stats().batches, 7u);
+
+    ///< the consumer stops after batch 2 and releases the producer
+    auto stop = [&](uint32_t batch, buffer_t&) { return batch < 2; };
+    ASSERT_EQ(pipeline.run(7, produce, stop), 3u);
+    ASSERT_TRUE(pipeline.producer_stats().batches <= 5);
+}
+
+// Test 9: An exception of either stage stops the pipeline and reaches the caller
+TEST(Pipeline_RethrowsStageExceptions) {
+    typedef std::vector<uint32_t> buffer_t;
+    std::vector<buffer_t>         buffers(2, buffer_t(16));
+    mqi::batch_pipeline<buffer_t> pipeline(buffers);
+    auto                          produce = [](uint32_t batch, buffer_t& b) { b[0] = batch; };
+    auto                          consume = [](uint32_t batch, buffer_t&) {
+        if (batch == 1) throw std::runtime_error("Scorer table full");
+        return true;
+    };
+    std::string what;
+    try {
+        pipeline.run(7, produce, consume);
+    } catch (const std::runtime_error& e) {
+        what = e.what();
+    }
+    ASSERT_EQ(what, std::string("Scorer table full"));
+    ASSERT_EQ(pipeline.consumer_stats().batches, 1u);
+
+    ///< the batches produced before the failure are still consumed
+    auto fail = [](uint32_t batch, buffer_t&) {
+        if (batch == 3) throw std::runtime_error("out of memory");
+    };
+    uint32_t consumed = 0;
+    auto     count    = [&](uint32_t, buffer_t&) {
+        consumed++;
+        return true;
+    };
+    what.clear();
+    try {
+        pipeline.run(7, fail, count);
+    } catch (const std::runtime_error& e) {
+        what = e.what();
+    }
+    ASSERT_EQ(what, std::string("out of memory"));
+    ASSERT_EQ(consumed, 3u);
+}
+
+int main() {
+    return mqi_test::TestRunner::instance().run_all();
+}
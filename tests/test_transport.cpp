@@ -0,0 +1,378 @@
+#include "test_framework.hpp"
+#include <moqui/base/scorers/mqi_scorer_energy_deposit.hpp>
+#include <moqui/kernel_functions/mqi_transport.hpp>
+#include <random>
+#include <vector>
+
+namespace
+{
+
+///< A 40 x 40 x 100 mm water phantom (1 mm voxels) with a bone and a lung slab
+struct slab_world_t {
+    mqi::grid3d<mqi::density_t, float> geo;
+    mqi::roi_t                         roi;
+    mqi::scorer<float>                 scr;
+    mqi::scorer<float>*                scorers[1];
+    mqi::node_t<float>                 child;
+    mqi::node_t<float>*                children[1];
+    mqi::node_t<float>                 world;
+
+    slab_world_t() :
+        geo(-20.0f, 20.0f, 41, -20.0f, 20.0f, 41, 0.0f, 100.0f, 101),
+        roi(mqi::DIRECT, 40 * 40 * 100), scr("edep", 40 * 40 * 100, mqi::energy_deposit<float>) {
+        mqi::density_t* rho = new mqi::density_t[40 * 40 * 100];
+        for (int k = 0; k < 100; ++k) {
+            const float d = (k >= 20 && k < 30) ? 1.8e-3f : ((k >= 45 && k < 60) ? 0.3e-3f : 1.0e-3f);
+            for (int ij = 0; ij < 40 * 40; ++ij)
+                rho[k * 40 * 40 + ij] = d;
+        }
+        geo.set_data(rho);
+        scr.dense_       = new double[scr.max_capacity_]();
+        scr.roi_         = &roi;
+        scorers[0]       = &scr;
+        child.geo        = &geo;
+        child.n_scorers  = 1;
+        child.scorers    = scorers;
+        children[0]      = &child;
+        world.n_children = 1;
+        world.children   = children;
+    }
+
+    ~slab_world_t() {
+        geo.delete_data_if_used();
+    }
+
+    ///< Energy deposit per 1 mm depth bin
+    std::vector<double>
+    depth_dose() const {
+        std::vector<double> dd(100, 0.0);
+        for (uint32_t v = 0; v < scr.max_capacity_; ++v)
+            dd[v / (40 * 40)] += scr.dense_[v];
+        return dd;
+    }
+};
+
+enum stepping_t { VOXEL, WOODCOCK, WOODCOCK_BLOCKS, SUPER_VOXEL };
+
+///< Transport n protons of energy ke along +z and return the depth-dose curve;
+///< with letd, also the LETd of the first 60 mm (in front of the Bragg peak)
+std::vector<double>
+pencil_beam_depth_dose(stepping_t mode, uint32_t n, float ke, double* letd = nullptr) {
+    slab_world_t        w;
+    const uint32_t      n_voxels = 40 * 40 * 100;
+    mqi::scorer<float>  fused("Dose", n_voxels, mqi::dose_to_water<float>, mqi::DOSE_LETD_HIT);
+    mqi::scorer<float>* scorers[2] = { &w.scr, &fused };
+    if (letd) {
+        fused.dense_ = new double[n_voxels]();
+        fused.roi_   = &w.roi;
+        fused.allocate_quantities();
+        w.child.scorers   = scorers;
+        w.child.n_scorers = 2;
+    }
+    if (mode == WOODCOCK || mode == WOODCOCK_BLOCKS) w.child.majorant_density = w.geo.max_data();
+    if (mode == WOODCOCK_BLOCKS) w.geo.build_majorants(8);
+    if (mode == SUPER_VOXEL) w.geo.build_super_voxels(4, 0.01f);
+    std::vector<mqi::vertex_t<float>> vertices(n);
+    for (auto& v : vertices) {
+        v.ke  = ke;
+        v.pos = mqi::vec3<float>(0.1f, 0.2f, -5.0f);
+        v.dir = mqi::vec3<float>(0.0f, 0.0f, 1.0f);
+    }
+    mqi::mqi_rng rng;
+    rng.seed(mode == VOXEL ? 7 : 5);
+    uint32_t tracked = 0;
+    mc::transport_histories<float>(&rng, &w.world, vertices.data(), 0, n, &tracked);
+    if (letd) {
+        double numerator = 0, denominator = 0;
+        for (uint32_t v = 0; v < 40 * 40 * 60; ++v) {
+            numerator += fused.quantity(v, 1);
+            denominator += fused.quantity(v, 2);
+        }
+        *letd = (denominator > 0) ? numerator / denominator : 0.0;
+        w.child.scorers   = w.scorers;
+        w.child.n_scorers = 1;
+    }
+    return w.depth_dose();
+}
+
+///< Compare a depth-dose curve of n protons of 100 MeV with the voxel-by-voxel one
+void
+check_depth_dose(const std::vector<double>& voxel, const std::vector<double>& test, uint32_t n) {
+    double sum_voxel = 0, sum_test = 0, z_voxel = 0, z_test = 0;
+    size_t peak_voxel = 0, peak_test = 0;
+    for (size_t k = 0; k < voxel.size(); ++k) {
+        sum_voxel += voxel[k];
+        sum_test += test[k];
+        z_voxel += voxel[k] * (k + 0.5);
+        z_test += test[k] * (k + 0.5);
+        if (voxel[k] > voxel[peak_voxel]) peak_voxel = k;
+        if (test[k] > test[peak_test]) peak_test = k;
+    }
+    ASSERT_TRUE(sum_voxel > 0.8 * n * 100.0);
+    ASSERT_NEAR(sum_test / sum_voxel, 1.0, 0.03);
+    ASSERT_NEAR(z_test / sum_test, z_voxel / sum_voxel, 1.0);
+    ASSERT_TRUE(peak_test + 2 >= peak_voxel && peak_test <= peak_voxel + 2);
+}
+
+}   // namespace
+
+// Test 1: Woodcock tracking, with one majorant or one per block, reproduces the
+// voxel-by-voxel depth dose and LETd (validation)
+TEST(Transport_WoodcockMatchesVoxelTracking) {
+    const uint32_t            n = 300;
+    double                    voxel_letd, letd;
+    const std::vector<double> voxel = pencil_beam_depth_dose(VOXEL, n, 100.0f, &voxel_letd);
+    ASSERT_TRUE(voxel_letd > 0);
+    check_depth_dose(voxel, pencil_beam_depth_dose(WOODCOCK, n, 100.0f, &letd), n);
+    ASSERT_NEAR(letd / voxel_letd, 1.0, 0.1);
+    check_depth_dose(voxel, pencil_beam_depth_dose(WOODCOCK_BLOCKS, n, 100.0f, &letd), n);
+    ASSERT_NEAR(letd / voxel_letd, 1.0, 0.1);
+}
+
+// Test 2: Steps across homogeneous super-voxels reproduce the voxel-by-voxel depth dose
+TEST(Transport_SuperVoxelMatchesVoxelTracking) {
+    const uint32_t n = 300;
+    check_depth_dose(pencil_beam_depth_dose(VOXEL, n, 100.0f),
+                     pencil_beam_depth_dose(SUPER_VOXEL, n, 100.0f),
+                     n);
+}
+
+// Test 3: Per-history random streams make the dose independent of how histories are split
+TEST(Transport_DoseIndependentOfHistorySplit) {
+    const uint32_t                    n = 60;
+    std::vector<mqi::vertex_t<float>> vertices(n);
+    for (uint32_t h = 0; h < n; ++h) {
+        vertices[h].ke  = 80.0f + 0.25f * h;
+        vertices[h].pos = mqi::vec3<float>(0.1f, 0.2f, -5.0f);
+        vertices[h].dir = mqi::vec3<float>(0.0f, 0.0f, 1.0f);
+    }
+    ///< all histories with one generator
+    slab_world_t w1;
+    mqi::mqi_rng rng(9, 1);
+    uint32_t     tracked = 0;
+    mc::transport_histories<float>(&rng, &w1.world, vertices.data(), 0, n, &tracked);
+    ///< two batches of three "threads", each with a generator in another state
+    slab_world_t             w2;
+    const uint32_t           split[] = { 0, 7, 20, 32, 33, 51, n };
+    std::vector<mqi::thrd_t> threads(3);
+    mqi::initialize_threads(threads.data(), 3, 9, 1);
+    for (uint32_t part = 0; part < 6; ++part) {
+        const uint32_t batch_first = (part < 3) ? 0 : split[3];
+        mqi::mqi_rng&  thread_rng  = threads[part % 3].rnd_generator;
+        thread_rng.history_offset  = batch_first;
+        mc::transport_histories<float>(&thread_rng,
+                                       &w2.world,
+                                       vertices.data() + batch_first,
+                                       split[part] - batch_first,
+                                       split[part + 1] - batch_first,
+                                       &tracked);
+    }
+    ///< same order of the deposits, so the sums are bitwise identical
+    for (uint32_t v = 0; v < w1.scr.max_capacity_; ++v)
+        ASSERT_TRUE(w1.scr.dense_[v] == w2.scr.dense_[v]);
+}
+
+// Test 4: The CPU track stack grows without dropping or moving tracks and pops in LIFO order
+TEST(TrackStack_GrowsWithoutDropping) {
+    mqi::track_stack_counters.reset();
+    {
+        mqi::track_stack_t<float> stack;
+        mqi::track_t<float>*      first = nullptr;
+        for (uint32_t n = 0; n < 100; ++n) {
+            mqi::track_t<float> trk;
+            trk.scorer_column = n;
+            stack.push_secondary(trk);
+            if (n == 0) first = &stack.top();
+        }
+        ASSERT_TRUE(first == &stack[0]);
+        ASSERT_EQ(stack.idx, 100u);
+        ASSERT_EQ(stack.n_dropped, 0u);
+        ASSERT_EQ(stack.n_overflow, 3u);   ///< 16 -> 32 -> 64 -> 128
+        ASSERT_EQ(stack.top().scorer_column, 99u);
+        stack.remove(40);   ///< the top track takes its place
+        ASSERT_EQ(stack[40].scorer_column, 99u);
+        for (uint32_t n = 99; n > 0; --n)
+            ASSERT_EQ(stack.pop().scorer_column, (n == 41) ? 99u : n - 1);
+        ASSERT_TRUE(stack.is_empty());
+    }
+    ASSERT_EQ(mqi::track_stack_counters.grown.load(), 3ULL);
+    ASSERT_EQ(mqi::track_stack_counters.max_depth.load(), 100u);
+}
+
+// Test 5: Deposits coalesced per voxel score the same totals with one insert per voxel
+TEST(DepositAccumulator_MatchesPerStepScoring) {
+    slab_world_t                          per_step, coalesced;
+    mc::deposit_accumulator_t<float>      acc;
+    mqi::track_t<float>                   track;
+    std::mt19937                          gen(4);
+    std::uniform_real_distribution<float> dE(0.0f, 0.5f);
+    uint32_t                              n_voxels = 0;
+    mqi::cnb_t                            last     = mqi::cnb_t(-1);
+    for (uint32_t step = 0; step < 5000; ++step) {
+        ///< runs of steps in one voxel, sometimes returning to an earlier one
+        const mqi::cnb_t cnb = (step / 7) % 300 + ((step % 97 == 0) ? 1 : 0);
+        if (cnb != last) n_voxels++;
+        last           = cnb;
+        track.dE       = dE(gen);
+        track.local_dE = (step % 5 == 0) ? 0.1f : 0.0f;
+        track.c_node   = &per_step.child;
+        mc::score_step<float>(track, per_step.geo, cnb, mqi::empty_pair, nullptr, 0);
+        track.c_node = &coalesced.child;
+        mc::score_step<float>(track, coalesced.geo, cnb, mqi::empty_pair, nullptr, 0, &acc);
+    }
+    mc::flush_deposits<float>(acc);
+    ASSERT_EQ(acc.n_steps, 5000ULL);
+    ASSERT_EQ(acc.n_flushes, uint64_t(n_voxels));
+    for (uint32_t v = 0; v < per_step.scr.max_capacity_; ++v)
+        ASSERT_NEAR(coalesced.scr.dense_[v], per_step.scr.dense_[v], 1e-9);
+}
+
+// Test 6: Every inlined scorer kind returns the value of its function pointer
+TEST(ScorerPolicy_MatchesFunctionPointer) {
+    slab_world_t               w;
+    mqi::fp_compute_hit<float> fps[]  = { mqi::energy_deposit<float>, mqi::dose_to_water<float>,
+                                          mqi::dose_to_medium<float>, mqi::LETd_weight1<float>,
+                                          mqi::LETd_weight2<float>,   mqi::LETt_weight2<float> };
+    mqi::hit_t                 hits[] = { mqi::ENERGY_DEPOSIT_HIT,   mqi::DOSE_TO_WATER_HIT,
+                                          mqi::DOSE_TO_MEDIUM_HIT,   mqi::LETD_NUMERATOR_HIT,
+                                          mqi::LETD_DENOMINATOR_HIT, mqi::TRACK_LENGTH_HIT };
+    std::mt19937                          gen(6);
+    std::uniform_real_distribution<float> u(0.0f, 1.0f);
+    mqi::track_t<float>                   track;
+    for (int n = 0; n < 1000; ++n) {
+        track.dE             = u(gen);
+        track.local_dE       = (n % 3 == 0) ? 0.1f : 0.0f;
+        track.primary        = (n % 2 == 0);
+        track.vtx0.ke        = 1.0f + 200.0f * u(gen);
+        track.vtx0.pos       = mqi::vec3<float>(u(gen), u(gen), 30.0f * u(gen));
+        track.vtx1.pos       = track.vtx0.pos + mqi::vec3<float>(0.0f, 0.0f, u(gen));
+        const mqi::cnb_t cnb = n % (40 * 40 * 100);
+        for (int k = 0; k < 6; ++k) {
+            mqi::scorer<float> generic("", 1, fps[k]);
+            mqi::scorer<float> inlined("", 1, fps[k], hits[k]);
+            ASSERT_EQ(mqi::compute_hit<float>(inlined, track, cnb, w.geo),
+                      mqi::compute_hit<float>(generic, track, cnb, w.geo));
+        }
+    }
+}
+
+// Test 7: One dose + LETd scorer scores what three separate scorers do
+TEST(FusedDoseLETd_MatchesSeparateScorers) {
+    slab_world_t       w;
+    const uint32_t     n_voxels = 40 * 40 * 100;
+    mqi::scorer<float> fused("Dose", n_voxels, mqi::dose_to_water<float>, mqi::DOSE_LETD_HIT);
+    mqi::scorer<float> dose("dose", n_voxels, mqi::dose_to_water<float>);
+    mqi::scorer<float> numerator("num", n_voxels, mqi::LETd_weight1<float>);
+    mqi::scorer<float> denominator("den", n_voxels, mqi::LETd_weight2<float>);
+    mqi::scorer<float>* scorers[4] = { &fused, &dose, &numerator, &denominator };
+    for (mqi::scorer<float>* scr : scorers) {
+        scr->dense_ = new double[n_voxels]();
+        scr->roi_   = &w.roi;
+    }
+    fused.allocate_quantities();
+    ASSERT_EQ(fused.n_quantities_, 3);
+    w.child.scorers   = scorers;
+    w.child.n_scorers = 4;
+
+    std::vector<mqi::vertex_t<float>> vertices(200);
+    for (auto& v : vertices) {
+        v.ke  = 120.0f;
+        v.pos = mqi::vec3<float>(0.1f, 0.2f, -5.0f);
+        v.dir = mqi::vec3<float>(0.0f, 0.0f, 1.0f);
+    }
+    mqi::mqi_rng rng(9);
+    uint32_t     tracked = 0;
+    mc::transport_histories<float>(&rng, &w.world, vertices.data(), 0, vertices.size(), &tracked);
+
+    double total_dose = 0;
+    for (uint32_t v = 0; v < n_voxels; ++v) {
+        total_dose += dose.dense_[v];
+        ASSERT_NEAR(fused.quantity(v, 0), dose.dense_[v], 1e-9 * dose.dense_[v]);
+        ASSERT_NEAR(fused.quantity(v, 1), numerator.dense_[v], 1e-9 * numerator.dense_[v]);
+        ASSERT_NEAR(fused.quantity(v, 2), denominator.dense_[v], 1e-9 * denominator.dense_[v]);
+    }
+    ASSERT_TRUE(total_dose > 0);
+    w.child.scorers   = w.scorers;
+    w.child.n_scorers = 1;
+}
+
+// Test 8: A step across several voxels scores the LETd and track length of
+// one step per voxel
+TEST(MultiVoxelStep_MatchesVoxelStepping) {
+    slab_world_t        along, per_voxel;
+    slab_world_t*       worlds[2] = { &along, &per_voxel };
+    const uint32_t      n_voxels  = 40 * 40 * 100;
+    mqi::scorer<float>  dose[2] = {
+        { "Dose", n_voxels, mqi::dose_to_water<float>, mqi::DOSE_LETD_HIT },
+        { "Dose", n_voxels, mqi::dose_to_water<float>, mqi::DOSE_LETD_HIT }
+    };
+    mqi::scorer<float> length[2] = {
+        { "TrackLength", n_voxels, mqi::LETt_weight2<float>, mqi::TRACK_LENGTH_HIT },
+        { "TrackLength", n_voxels, mqi::LETt_weight2<float>, mqi::TRACK_LENGTH_HIT }
+    };
+    mqi::scorer<float>* scorers[2][2] = { { &dose[0], &length[0] }, { &dose[1], &length[1] } };
+    for (int w = 0; w < 2; ++w) {
+        for (mqi::scorer<float>* scr : scorers[w]) {
+            scr->dense_ = new double[n_voxels]();
+            scr->roi_   = &worlds[w]->roi;
+        }
+        scorers[w][0]->allocate_quantities();
+        worlds[w]->child.scorers   = scorers[w];
+        worlds[w]->child.n_scorers = 2;
+    }
+
+    ///< 4.5 mm along +z from the middle of voxel 2 through voxels 2 to 6
+    mqi::track_t<float> track;
+    track.vtx0.ke  = 100.0f;
+    track.vtx0.pos = mqi::vec3<float>(0.1f, 0.2f, 2.3f);
+    track.vtx0.dir = mqi::vec3<float>(0.0f, 0.0f, 1.0f);
+    track.vtx1     = track.vtx0;
+    track.vtx1.pos = mqi::vec3<float>(0.1f, 0.2f, 6.8f);
+    track.dE       = 2.0f;
+    track.local_dE = 0.3f;
+    track.its.cell = along.geo.index(track.vtx0.pos, track.vtx0.dir);
+    track.c_node   = &along.child;
+    mqi::dda_t<float> dda;
+    mqi::cnb_t        cnbs[mc::step_max_voxels];
+    float             lens[mc::step_max_voxels];
+    float             travelled;
+    const uint16_t    n =
+      mc::trace_voxels<float>(track, along.geo, dda, 4.5f, cnbs, lens, travelled);
+    ASSERT_EQ(n, 5);
+    mc::score_along_step<float>(
+      track, along.geo, cnbs, lens, lens, n, 4.5f, mqi::empty_pair, nullptr, 0, nullptr);
+    ASSERT_NEAR(track.vtx0.pos.z, 2.3f, 1e-6);
+    ASSERT_NEAR(track.vtx1.pos.z, 6.8f, 1e-6);
+
+    mqi::track_t<float> step = track;
+    step.c_node              = &per_voxel.child;
+    const float bounds[6]    = { 2.3f, 3.0f, 4.0f, 5.0f, 6.0f, 6.8f };
+    for (int v = 0; v < 5; ++v) {
+        step.vtx0.pos.z = bounds[v];
+        step.vtx1.pos.z = bounds[v + 1];
+        step.dE         = track.dE * (bounds[v + 1] - bounds[v]) / 4.5f;
+        step.local_dE   = (v == 4) ? track.local_dE : 0.0f;
+        mc::score_step<float>(step, per_voxel.geo, cnbs[v], mqi::empty_pair, nullptr, 0);
+    }
+
+    double total = 0;
+    for (int v = 0; v < 5; ++v) {
+        for (uint8_t q = 0; q < 3; ++q) {
+            const double expected = scorers[1][0]->quantity(cnbs[v], q);
+            ASSERT_TRUE(expected > 0);
+            ASSERT_NEAR(scorers[0][0]->quantity(cnbs[v], q), expected, 1e-5 * expected);
+        }
+        const double expected = scorers[1][1]->dense_[cnbs[v]];
+        ASSERT_NEAR(scorers[0][1]->dense_[cnbs[v]], expected, 1e-5 * expected);
+        total += scorers[0][1]->dense_[cnbs[v]];
+    }
+    ASSERT_NEAR(total, 4.5, 1e-5);
+    for (int w = 0; w < 2; ++w) {
+        worlds[w]->child.scorers   = worlds[w]->scorers;
+        worlds[w]->child.n_scorers = 1;
+    }
+}
+
+int main() {
+    return mqi_test::TestRunner::instance().run_all();
+}
@@ -9,6 +9,7 @@
 #include <moqui/base/materials/mqi_patient_materials.hpp>
 #include <moqui/base/mqi_treatment_machine_ion.hpp>
 #include <moqui/base/distributions/mqi_phsp6d_ray.hpp>
+#include <moqui/base/mqi_beamlet_arena.hpp>
 #include <moqui/treatment_machines/spline_interp.hpp>
 
 namespace mqi{
@@ -129,7 +130,8 @@ public:
     mqi::beamlet<T>
     characterize_beamlet(const mqi::beam_module_ion::logspot& s,
         const float                       source_to_isocenter_mm,
-        const bool rsuse)
+        const bool rsuse,
+        mqi::beamlet_arena<T>&            arena)
     {
         // Range shifter correction
         float newBeamStartingPos{ -source_to_isocenter_mm };
@@ -139,9 +141,6 @@ public:
         // Constant energy 
         double energySpread = this->beamEnergySpreadInterp(s.e);
 
-        // Gaussian energy spread distribution
-        auto energy = new mqi::norm_1d<T>({ s.e }, { energySpread });
-
         // Caculate direction based on SAD and spot's position
         mqi::vec3<T> dir(std::atan(s.x/treatment_machine_ion<T>::SAD_[0]),
                          std::atan(s.y/treatment_machine_ion<T>::SAD_[1]),
@@ -165,9 +164,9 @@ public:
         std::array<T,6> beamlet_mean = { pos.x, pos.y, pos.z, dir.x, dir.y, dir.z };
         std::array<T,6> beamlet_sigm = { spotSize , spotSize, 0, angularSpread, angularSpread, 0};
         std::array<T,2> beamlet_divergence = { divergence, divergence };
-        auto beamlet = new mqi::phsp_6d_ray<T>(beamlet_mean, beamlet_sigm, beamlet_divergence, newBeamStartingPos);
 
-        return mqi::beamlet<T>(energy, beamlet);
+        // Gaussian energy spread and ray phase-space, stored by value in the arena
+        return arena.append(s.e, energySpread, beamlet_mean, beamlet_sigm, beamlet_divergence, newBeamStartingPos);
     }
 
     mqi::rangeshifter*
@@ -258,6 +257,7 @@ public:
 
         // Creating beam source with log file information
         mqi::beamsource<T> beamsource;
+        beamsource.arena_ = std::make_shared<mqi::beamlet_arena<T>>();
 
         for (int i = 0; i < logfileData.beamInfo.size(); i++)
         {
@@ -272,7 +272,7 @@ public:
                     logSpotInfo.muCount = logfileData.beamInfo[i][j].muCount[k];
                     logSpotInfo.x = logfileData.beamInfo[i][j].posX[k];
                     logSpotInfo.y = logfileData.beamInfo[i][j].posY[k];
-                    beamsource.append_beamlet_log(this->characterize_beamlet(logSpotInfo, treatment_machine<T>::source_to_isocenter_mm_, rsuse), this->characterize_history(logSpotInfo), pcoord);
+                    beamsource.append_beamlet_log(this->characterize_beamlet(logSpotInfo, treatment_machine<T>::source_to_isocenter_mm_, rsuse, *beamsource.arena_), this->characterize_history(logSpotInfo), pcoord);
                 }
             }
         }